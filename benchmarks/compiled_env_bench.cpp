@@ -0,0 +1,112 @@
+#include "pch.h"
+
+#include "ooze/core.h"
+#include "ooze/executor.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+namespace ooze {
+
+namespace {
+
+constexpr std::string_view Script = "fn f(x: i32) -> i32 { mul(add(x, 1), add(x, 2)) }";
+
+NativeRegistry registry() {
+  return create_primitive_registry()
+    .add_fn("add", [](i32 x, i32 y) { return x + y; })
+    .add_fn("mul", [](i32 x, i32 y) { return x * y; });
+}
+
+Env make_env() {
+  Env env(registry());
+  if(!env.parse_scripts(std::array{Script}).has_value()) {
+    fmt::print(stderr, "failed to parse script\n");
+    std::exit(EXIT_FAILURE);
+  }
+  return env;
+}
+
+i32 await(Future f) {
+  i32 result = 0;
+  std::move(f).then([&](Any a) { result = any_cast<i32>(a); });
+  return result;
+}
+
+// How requests were served before, every client thread holding its own env and running an expression per request
+i64 env_per_thread_request(Env& env, Executor& ex, int i) {
+  Binding b = env.run(ex, fmt::format("f({})", i)).value();
+  return await(std::move(b.values[0].future));
+}
+
+i64 compiled_request(const CompiledEnv& compiled, Executor& ex, int i) {
+  std::vector<Future> results = compiled.call(ex, "f", make_vector(std::pair(Future(Any(i)), type_id<i32>()))).value();
+  return await(std::move(results[0]));
+}
+
+// Requests per second served by num_clients threads each making requests calls to request(client, i)
+template <typename MakeClient, typename F>
+double requests_per_second(int num_clients, int requests, MakeClient make_client, F request) {
+  std::atomic<i64> checksum = 0;
+
+  const auto start = std::chrono::steady_clock::now();
+
+  std::vector<std::thread> clients;
+  for(int c = 0; c < num_clients; c++) {
+    clients.emplace_back([&]() {
+      auto client = make_client();
+      Executor ex = make_seq_executor();
+      i64 sum = 0;
+      for(int i = 0; i < requests; i++) {
+        sum += request(client, ex, i);
+      }
+      checksum.fetch_add(sum, std::memory_order_relaxed);
+    });
+  }
+
+  for(std::thread& t : clients) {
+    t.join();
+  }
+
+  // Every client sums f(i) = (i + 1)(i + 2) over [0, requests), which is n(n + 1)(n + 2) / 3
+  const i64 n = requests;
+  const i64 expected = num_clients * (n * (n + 1) * (n + 2) / 3);
+
+  const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  return checksum.load() != expected ? 0 : num_clients * requests / seconds;
+}
+
+} // namespace
+
+} // namespace ooze
+
+int main(int argc, const char** argv) {
+  const int requests = argc > 1 ? std::atoi(argv[1]) : 2000;
+  const int max_clients = argc > 2 ? std::atoi(argv[2]) : int(std::thread::hardware_concurrency());
+
+  const ooze::CompiledEnv compiled = ooze::make_env().compile();
+
+  fmt::print("{} requests per client\n", requests);
+  fmt::print("{:>8} {:>16} {:>16}\n", "clients", "env/thread req/s", "compiled req/s");
+
+  for(int clients = 1; clients <= std::max(1, max_clients); clients *= 2) {
+    const double per_thread =
+      ooze::requests_per_second(clients, requests, ooze::make_env, ooze::env_per_thread_request);
+
+    const double shared = ooze::requests_per_second(
+      clients, requests, [&]() -> const ooze::CompiledEnv& { return compiled; }, ooze::compiled_request);
+
+    if(per_thread == 0 || shared == 0) {
+      fmt::print(stderr, "wrong results\n");
+      return EXIT_FAILURE;
+    }
+
+    fmt::print("{:>8} {:>16.0f} {:>16.0f}\n", clients, per_thread, shared);
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,73 @@
+#include "pch.h"
+
+#include "ooze/executor.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+
+namespace ooze {
+
+namespace {
+
+constexpr int TasksPerRequest = 8;
+
+// How executors were set up before they shared arenas, a fresh arena for every request
+void dedicated_arena_request(int num_threads, std::atomic<int>& counter) {
+  tbb::task_arena arena(num_threads);
+  arena.initialize();
+  tbb::task_group group;
+
+  for(int i = 0; i < TasksPerRequest; i++) {
+    arena.execute([&]() { group.run([&]() { counter.fetch_add(1, std::memory_order_relaxed); }); });
+  }
+  arena.execute([&]() { group.wait(); });
+}
+
+void shared_arena_request(int num_threads, std::atomic<int>& counter) {
+  Executor ex = make_tbb_executor(num_threads);
+
+  for(int i = 0; i < TasksPerRequest; i++) {
+    ex.run([&]() { counter.fetch_add(1, std::memory_order_relaxed); });
+  }
+  ex.wait();
+}
+
+template <typename F>
+double us_per_request(int requests, F f) {
+  const auto start = std::chrono::steady_clock::now();
+  for(int i = 0; i < requests; i++) {
+    f();
+  }
+  return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / requests;
+}
+
+} // namespace
+
+} // namespace ooze
+
+int main(int argc, const char** argv) {
+  const int requests = argc > 1 ? std::atoi(argv[1]) : 2000;
+  const int num_threads = argc > 2 ? std::atoi(argv[2]) : -1;
+
+  std::atomic<int> counter = 0;
+
+  // Warm up the shared arena so its one time startup isn't attributed to the first request
+  ooze::shared_arena_request(num_threads, counter);
+
+  const double dedicated =
+    ooze::us_per_request(requests, [&]() { ooze::dedicated_arena_request(num_threads, counter); });
+  const double shared =
+    ooze::us_per_request(requests, [&]() { ooze::shared_arena_request(num_threads, counter); });
+
+  if(counter.load() != (2 * requests + 1) * ooze::TasksPerRequest) {
+    fmt::print(stderr, "lost tasks\n");
+    return EXIT_FAILURE;
+  }
+
+  fmt::print("{} requests of {} tasks\n", requests, ooze::TasksPerRequest);
+  fmt::print("dedicated arena {:8.2f} us/request\n", dedicated);
+  fmt::print("shared arena    {:8.2f} us/request\n", shared);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,126 @@
+#include "pch.h"
+
+#include "lexer.h"
+
+#include <ctre.hpp>
+
+#include <chrono>
+#include <cstdlib>
+#include <string>
+
+namespace ooze {
+
+namespace {
+
+// The regex lexer lex() replaced, every matcher runs on every token and the longest match wins
+namespace regex {
+
+constexpr auto whitespace_re = ctll::fixed_string{"^\\s+"};
+constexpr auto comment_re = ctll::fixed_string{"^//[^\\n]*"};
+constexpr auto keyword_re = ctll::fixed_string{"^let|^fn|^if|^else|^mod"};
+constexpr auto underscore_re = ctll::fixed_string{"^_"};
+constexpr auto ident_re = ctll::fixed_string{"^[a-zA-Z_][a-zA-Z0-9_]*"};
+constexpr auto symbol_re = ctll::fixed_string{R"(^\(|^\)|^\{|^\}|^,|^\.|^::|^:|^&|^->|^=>|^=|^;)"};
+
+constexpr auto int_re = ctll::fixed_string{"^-?\\d+(i8|i16|i32|i64|u8|u16|u32|u64)?"};
+constexpr auto float_re = ctll::fixed_string{R"(^-?\d+?\.\d+f?)"};
+constexpr auto bool_re = ctll::fixed_string{"^true|^false"};
+constexpr auto string_re = ctll::fixed_string{"^\".*?\"|^'.*?'"};
+
+template <auto& T>
+using matcher = ctre::regex_search_t<typename ctre::regex_builder<T>::type>;
+
+constexpr std::tuple MATCHERS = {
+  std::tuple(TokenType::Whitespace, matcher<whitespace_re>{}),
+  std::tuple(TokenType::Comment, matcher<comment_re>{}),
+  std::tuple(TokenType::Keyword, matcher<keyword_re>{}),
+  std::tuple(TokenType::Underscore, matcher<underscore_re>{}),
+  std::tuple(TokenType::Symbol, matcher<symbol_re>{}),
+  std::tuple(TokenType::LiteralFloat, matcher<float_re>{}),
+  std::tuple(TokenType::LiteralInt, matcher<int_re>{}),
+  std::tuple(TokenType::LiteralBool, matcher<bool_re>{}),
+  std::tuple(TokenType::LiteralString, matcher<string_re>{}),
+  std::tuple(TokenType::Ident, matcher<ident_re>{})};
+
+template <typename... Ts>
+auto lex_one(const std::tuple<Ts...>& ts, std::string_view sv) {
+  const std::array<std::pair<TokenType, int>, sizeof...(Ts)> matches{
+    {{std::get<0>(std::get<Ts>(ts)), (int)std::get<1>(std::get<Ts>(ts))(sv).to_view().size()}...}};
+
+  return *std::max_element(matches.begin(), matches.end(), [](const auto& a, const auto& b) {
+    return a.second < b.second;
+  });
+}
+
+std::pair<std::vector<Token>, int> lex(std::string_view sv) {
+  std::vector<Token> tokens;
+
+  int offset = 0;
+  while(!sv.empty()) {
+    const auto [type, size] = lex_one(MATCHERS, sv);
+
+    if(size == 0) {
+      break;
+    } else {
+      if(type != TokenType::Whitespace && type != TokenType::Comment) {
+        tokens.push_back(Token{type, {offset, offset + size}});
+      }
+
+      offset += size;
+      sv.remove_prefix(size);
+    }
+  }
+
+  return {std::move(tokens), offset};
+}
+
+} // namespace regex
+
+std::string generate_script(int fn_count) {
+  std::string src;
+  for(int i = 0; i < fn_count; i++) {
+    src += fmt::format("// f{} combines its inputs with a few literals of every kind\n", i);
+    src += fmt::format("fn f{}(x: i32, y: &f32, _: string) -> (i32, f32, string) {{\n", i);
+    src += fmt::format("  let z = add(x, {}i32);\n", i);
+    src += fmt::format("  let w = if le(z, -{}) {{ y.mul({}.5f) }} else {{ 0.25 }};\n", i, i);
+    src += "  (z, w, \"a string literal\", 'c', true, false, util::g(w))\n}\n\n";
+  }
+  return src;
+}
+
+template <typename F>
+double best_seconds(int iterations, F f) {
+  double best = std::numeric_limits<double>::max();
+  for(int i = 0; i < iterations; i++) {
+    const auto start = std::chrono::steady_clock::now();
+    f();
+    best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+  }
+  return best;
+}
+
+} // namespace
+
+} // namespace ooze
+
+int main(int argc, const char** argv) {
+  const int fn_count = argc > 1 ? std::atoi(argv[1]) : 20000;
+  const int iterations = argc > 2 ? std::atoi(argv[2]) : 5;
+
+  const std::string src = ooze::generate_script(fn_count);
+
+  if(ooze::lex(src) != ooze::regex::lex(src)) {
+    fmt::print(stderr, "lexers disagree\n");
+    return EXIT_FAILURE;
+  }
+
+  const double mb = double(src.size()) / (1024 * 1024);
+  const double lex_s = ooze::best_seconds(iterations, [&]() { return ooze::lex(src); });
+  const double regex_s = ooze::best_seconds(iterations, [&]() { return ooze::regex::lex(src); });
+
+  fmt::print("{:.1f} MB, {} tokens\n", mb, ooze::lex(src).first.size());
+  fmt::print("lex       {:8.2f} ms {:8.1f} MB/s\n", lex_s * 1000, mb / lex_s);
+  fmt::print("regex lex {:8.2f} ms {:8.1f} MB/s\n", regex_s * 1000, mb / regex_s);
+
+  return EXIT_SUCCESS;
+}
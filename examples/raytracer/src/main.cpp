@@ -41,11 +41,11 @@ constexpr std::optional<bool> COPY_TYPE = std::optional(true);
 
 ooze::NativeRegistry add_basic_fns(ooze::NativeRegistry r) {
   return std::move(r)
-    .add_fn("add", [](int x, int y) { return x + y; })
-    .add_fn("add", [](float x, float y) { return x + y; })
-    .add_fn("sub", [](float x, float y) { return x - y; })
-    .add_fn("modulo", [](int x, int y) { return x % y; })
-    .add_fn("eq", [](int x, int y) { return x == y; });
+    .add_fn("add", [](int x, int y) { return x + y; }, ooze::Cost::Cheap, ooze::Purity::Pure)
+    .add_fn("add", [](float x, float y) { return x + y; }, ooze::Cost::Cheap, ooze::Purity::Pure)
+    .add_fn("sub", [](float x, float y) { return x - y; }, ooze::Cost::Cheap, ooze::Purity::Pure)
+    .add_fn("modulo", [](int x, int y) { return x % y; }, ooze::Cost::Cheap, ooze::Purity::Pure)
+    .add_fn("eq", [](int x, int y) { return x == y; }, ooze::Cost::Cheap, ooze::Purity::Pure);
 }
 
 template <typename T, size_t N>
@@ -60,21 +60,24 @@ ooze::NativeRegistry add_vec_entries(ooze::NativeRegistry r) {
 
   r.add_type<V>(fmt::format("Vec{}{}", N, suffix), COPY_TYPE);
 
-  r.add_fn(fmt::format("vec{}{}", N, suffix), []() { return V{}; });
-  r.add_fn(fmt::format("vec{}{}", N, suffix), constructor(std::make_index_sequence<N>()));
-
-  r.add_fn("add", [](V a, V b) { return a + b; });
-  r.add_fn("sub", [](V a, V b) { return a - b; });
-  r.add_fn("mul", [](V a, V b) { return a * b; });
-  r.add_fn("mul", [](T a, V b) { return a * b; });
-  r.add_fn("mul", [](V a, T b) { return a * b; });
-  r.add_fn("div", [](V a, T b) { return a / b; });
+  r.add_fn(fmt::format("vec{}{}", N, suffix), []() { return V{}; }, ooze::Cost::Cheap, ooze::Purity::Pure);
+  r.add_fn(fmt::format("vec{}{}", N, suffix),
+           constructor(std::make_index_sequence<N>()),
+           ooze::Cost::Cheap,
+           ooze::Purity::Pure);
+
+  r.add_fn("add", [](V a, V b) { return a + b; }, ooze::Cost::Cheap, ooze::Purity::Pure);
+  r.add_fn("sub", [](V a, V b) { return a - b; }, ooze::Cost::Cheap, ooze::Purity::Pure);
+  r.add_fn("mul", [](V a, V b) { return a * b; }, ooze::Cost::Cheap, ooze::Purity::Pure);
+  r.add_fn("mul", [](T a, V b) { return a * b; }, ooze::Cost::Cheap, ooze::Purity::Pure);
+  r.add_fn("mul", [](V a, T b) { return a * b; }, ooze::Cost::Cheap, ooze::Purity::Pure);
+  r.add_fn("div", [](V a, T b) { return a / b; }, ooze::Cost::Cheap, ooze::Purity::Pure);
   r.add_fn("to_string", [](const V& v) { return knot::debug(v); });
 
-  r.add_fn("x", [](V a) { return a[0]; });
-  r.add_fn("y", [](V a) { return a[1]; });
+  r.add_fn("x", [](V a) { return a[0]; }, ooze::Cost::Cheap, ooze::Purity::Pure);
+  r.add_fn("y", [](V a) { return a[1]; }, ooze::Cost::Cheap, ooze::Purity::Pure);
   if constexpr(N >= 3) {
-    r.add_fn("z", [](V a) { return a[2]; });
+    r.add_fn("z", [](V a) { return a[2]; }, ooze::Cost::Cheap, ooze::Purity::Pure);
   }
 
   return r;
@@ -161,13 +164,18 @@ ooze::NativeRegistry create_registry() {
               Image img = create_empty_image(view.size);
               raytrace(camera, view, scene, img.span());
               return img;
-            })
+            },
+            ooze::Cost::Expensive)
     .add_fn("raytrace_row_parallel",
             [](Camera camera, ViewPort view, const Scene& scene, Image img, int row) {
               raytrace_row_parallel(camera, view, scene, row, img.span().subspan(view.size[0] * row, view.size[0]));
               return img;
-            })
-    .add_fn("write_png", [](const Image& img, const std::string& str) { return write_png(img, str.c_str()); });
+            },
+            ooze::Cost::Expensive)
+    .add_fn("write_png",
+            [](const Image& img, const std::string& str) { return write_png(img, str.c_str()); },
+            ooze::Cost::Unknown,
+            ooze::Purity::Impure);
 }
 
 } // namespace rt
@@ -2,7 +2,11 @@
 
 #include "ooze/type.h"
 
+#include <cstddef>
 #include <exception>
+#include <new>
+#include <type_traits>
+#include <utility>
 
 namespace ooze {
 
@@ -15,53 +19,118 @@ struct BadCopy : std::runtime_error {
 };
 
 // Any implementation that works with move-only types (and throws when trying to copy them)
-// TODO: sbo optimization
+// Small trivially copyable types are stored inline, everything else is heap allocated
 class Any {
-  struct Concept {
-    virtual ~Concept() = default;
-    virtual std::unique_ptr<Concept> clone() const = 0;
+  static constexpr size_t InlineSize = 2 * sizeof(void*);
+
+  template <typename T>
+  static constexpr bool stored_inline =
+    sizeof(T) <= InlineSize && alignof(T) <= alignof(void*) && std::is_trivially_copyable_v<T>;
+
+  // Static per type operations, moving is always a bitwise copy of the storage
+  struct VTable {
+    void (*copy)(const Any& src, Any& dst);
+    void (*destroy)(Any&);
   };
 
   template <typename T>
-  struct Concrete final : Concept {
-    Concrete(T&& t) : val(std::move(t)) {}
-    Concrete(const T& t) : val(t) {}
-
-    T val;
-
-    std::unique_ptr<Concept> clone() const override {
-      if constexpr(std::is_copy_constructible_v<T>) {
-        return std::make_unique<Concrete<T>>(val);
-      } else {
-        throw BadCopy();
-      }
-    };
+  static void copy(const Any& src, Any& dst) {
+    if constexpr(!std::is_copy_constructible_v<T>) {
+      throw BadCopy();
+    } else if constexpr(stored_inline<T>) {
+      new(dst._storage.buffer) T(*src.get<T>());
+    } else {
+      dst._storage.heap = new T(*src.get<T>());
+    }
+  }
+
+  template <typename T>
+  static void destroy(Any& any) {
+    delete any.get<T>();
+  }
+
+  template <typename T>
+  static constexpr VTable vtable = {copy<T>, stored_inline<T> ? nullptr : destroy<T>};
+
+  union Storage {
+    void* heap;
+    alignas(void*) std::byte buffer[InlineSize];
   };
 
-  std::unique_ptr<Concept> _concept;
+  Storage _storage = {};
+  const VTable* _vtable = nullptr;
   TypeID _type = {};
 
+  template <typename T>
+  T* get() {
+    if constexpr(stored_inline<T>) {
+      return std::launder(reinterpret_cast<T*>(_storage.buffer));
+    } else {
+      return static_cast<T*>(_storage.heap);
+    }
+  }
+
+  template <typename T>
+  const T* get() const {
+    return const_cast<Any&>(*this).get<T>();
+  }
+
+  void steal(Any& a) {
+    _storage = a._storage;
+    _vtable = std::exchange(a._vtable, nullptr);
+    _type = std::exchange(a._type, TypeID{});
+  }
+
+  void reset() {
+    if(_vtable && _vtable->destroy) {
+      _vtable->destroy(*this);
+    }
+    _vtable = nullptr;
+    _type = {};
+  }
+
 public:
   Any() = default;
-  ~Any() = default;
+  ~Any() { reset(); }
 
   template <typename T, typename = std::enable_if_t<!std::is_same_v<std::decay_t<T>, Any>>>
-  explicit Any(T&& t)
-      : _concept(std::make_unique<Concrete<std::decay_t<T>>>(std::forward<T>(t)))
-      , _type(type_id(decay(knot::Type<T>{}))) {}
+  explicit Any(T&& t) : _vtable(&vtable<std::decay_t<T>>), _type(type_id(decay(knot::Type<T>{}))) {
+    using D = std::decay_t<T>;
+    if constexpr(stored_inline<D>) {
+      new(_storage.buffer) D(std::forward<T>(t));
+    } else {
+      _storage.heap = new D(std::forward<T>(t));
+    }
+  }
+
+  Any(Any&& a) noexcept { steal(a); }
 
-  Any(Any&&) = default;
-  Any& operator=(Any&&) = default;
+  Any& operator=(Any&& a) noexcept {
+    if(this != &a) {
+      reset();
+      steal(a);
+    }
+    return *this;
+  }
 
-  Any(const Any& a) : _concept(a._concept->clone()), _type(a._type) {}
+  Any(const Any& a) {
+    if(a._vtable) {
+      a._vtable->copy(a, *this);
+      _vtable = a._vtable;
+      _type = a._type;
+    }
+  }
 
   Any& operator=(const Any& a) {
-    _concept = a._concept->clone();
-    _type = a._type;
+    if(this != &a) {
+      Any copy = a;
+      reset();
+      steal(copy);
+    }
     return *this;
   }
 
-  bool has_value() const { return _concept != nullptr; }
+  bool has_value() const { return _vtable != nullptr; }
   TypeID type() const { return _type; }
 
   template <typename T>
@@ -83,7 +152,7 @@ public:
 template <typename T>
 T& any_cast(Any& any) {
   if(type_id(knot::Type<T>{}) == any.type()) {
-    return static_cast<Any::Concrete<T>&>(*any._concept).val;
+    return *any.get<T>();
   } else {
     throw BadCast();
   }
@@ -92,7 +161,7 @@ T& any_cast(Any& any) {
 template <typename T>
 const T& any_cast(const Any& any) {
   if(type_id(knot::Type<T>{}) == any.type()) {
-    return static_cast<const Any::Concrete<T>&>(*any._concept).val;
+    return *any.get<T>();
   } else {
     throw BadCast();
   }
@@ -101,7 +170,7 @@ const T& any_cast(const Any& any) {
 template <typename T>
 T&& any_cast(Any&& any) {
   if(type_id(knot::Type<T>{}) == any.type()) {
-    return std::move(static_cast<Any::Concrete<T>&>(*any._concept).val);
+    return std::move(*any.get<T>());
   } else {
     throw BadCast();
   }
@@ -110,7 +179,7 @@ T&& any_cast(Any&& any) {
 template <typename T>
 T* any_cast(Any* any) {
   if(type_id(knot::Type<T>{}) == any->type()) {
-    return &static_cast<Any::Concrete<T>&>(*any->_concept).val;
+    return any->get<T>();
   } else {
     return nullptr;
   }
@@ -119,7 +188,7 @@ T* any_cast(Any* any) {
 template <typename T>
 const T* any_cast(const Any* any) {
   if(type_id(knot::Type<T>{}) == any->type()) {
-    return &static_cast<const Any::Concrete<T>&>(*any->_concept).val;
+    return any->get<T>();
   } else {
     return nullptr;
   }
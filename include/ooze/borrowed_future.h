@@ -3,21 +3,78 @@
 #include "ooze/any.h"
 #include "ooze/future.h"
 
-#include <functional>
-#include <mutex>
-#include <vector>
+#include <atomic>
+#include <memory>
 
 namespace ooze {
 
+struct BorrowedContinuation {
+  BorrowedContinuation* next = nullptr;
+
+  virtual ~BorrowedContinuation() = default;
+  virtual void operator()(const Any&) = 0;
+};
+
+template <typename F>
+struct BorrowedContinuationFn final : BorrowedContinuation {
+  F f;
+
+  explicit BorrowedContinuationFn(F f) : f(std::move(f)) {}
+  void operator()(const Any& value) override { std::move(f)(value); }
+};
+
+// Continuations are pushed onto a lock-free stack until the value arrives and swaps in the ready marker
 struct BorrowedSharedBlock {
   Promise promise;
   Any value;
-  std::mutex mutex;
-  std::vector<std::function<void(const Any&)>> continuations;
-  bool value_ready = false;
+  std::atomic<BorrowedContinuation*> continuations = nullptr;
+
+  // Only ever compared against, never dereferenced
+  static BorrowedContinuation* ready_marker() {
+    return reinterpret_cast<BorrowedContinuation*>(alignof(BorrowedContinuation));
+  }
 
   BorrowedSharedBlock(Promise&& p) : promise(std::move(p)) {}
-  ~BorrowedSharedBlock() noexcept(false) { std::move(promise).send(std::move(value)); }
+
+  ~BorrowedSharedBlock() noexcept(false) {
+    // Continuations only remain if the value never arrived
+    BorrowedContinuation* c = continuations.load(std::memory_order_acquire);
+    while(c != nullptr && c != ready_marker()) {
+      delete std::exchange(c, c->next);
+    }
+
+    std::move(promise).send(std::move(value));
+  }
+
+  bool ready() const { return continuations.load(std::memory_order_acquire) == ready_marker(); }
+
+  // Returns false if the value is already ready, in which case the caller should invoke the continuation itself
+  bool push(BorrowedContinuation* c) {
+    BorrowedContinuation* head = continuations.load(std::memory_order_acquire);
+    do {
+      if(head == ready_marker()) {
+        return false;
+      }
+      c->next = head;
+    } while(!continuations.compare_exchange_weak(head, c, std::memory_order_acq_rel, std::memory_order_acquire));
+    return true;
+  }
+
+  void set_value(Any v) {
+    value = std::move(v);
+
+    // Reversed so continuations run in the order they were added
+    BorrowedContinuation* head = continuations.exchange(ready_marker(), std::memory_order_acq_rel);
+    BorrowedContinuation* reversed = nullptr;
+    while(head != nullptr) {
+      reversed = std::exchange(head, std::exchange(head->next, reversed));
+    }
+
+    while(reversed != nullptr) {
+      const std::unique_ptr<BorrowedContinuation> c(std::exchange(reversed, reversed->next));
+      (*c)(value);
+    }
+  }
 };
 
 class BorrowedFuture {
@@ -26,13 +83,15 @@ public:
 
   template <typename F, typename = std::enable_if_t<std::is_same_v<void, std::invoke_result_t<F, const Any&>>>>
   void then(F f) {
-    std::unique_lock lk(_block->mutex);
-
-    if(_block->value_ready) {
-      lk.unlock();
+    if(_block->ready()) {
       std::move(f)(_block->value);
     } else {
-      _block->continuations.emplace_back(std::move(f));
+      auto c = std::make_unique<BorrowedContinuationFn<F>>(std::move(f));
+      if(_block->push(c.get())) {
+        c.release();
+      } else {
+        std::move(c->f)(_block->value);
+      }
     }
   }
 
@@ -40,15 +99,7 @@ public:
   Future then(F f) {
     auto [p, new_future] = make_promise_future();
 
-    std::unique_lock lk(_block->mutex);
-
-    if(_block->value_ready) {
-      lk.unlock();
-      std::move(p).send(std::move(f)(_block->value));
-    } else {
-      _block->continuations.emplace_back([f = std::move(f), p = std::make_shared<Promise>(std::move(p))](
-                                           const Any& value) mutable { std::move(*p).send(std::move(f)(value)); });
-    }
+    then([f = std::move(f), p = std::move(p)](const Any& value) mutable { std::move(p).send(std::move(f)(value)); });
 
     return std::move(new_future);
   }
@@ -62,29 +113,18 @@ public:
 private:
   std::shared_ptr<BorrowedSharedBlock> _block;
 
-  friend std::pair<BorrowedFuture, Future> borrow(Future, int);
+  friend std::pair<BorrowedFuture, Future> borrow(Future);
 
   BorrowedFuture(std::shared_ptr<BorrowedSharedBlock> block) : _block(std::move(block)) {}
 };
 
-inline std::pair<BorrowedFuture, Future> borrow(Future f, int expected_continuations = 4) {
+inline std::pair<BorrowedFuture, Future> borrow(Future f) {
   auto [new_p, new_f] = make_promise_future();
 
   auto block = std::make_shared<BorrowedSharedBlock>(std::move(new_p));
-  block->continuations.reserve(expected_continuations);
 
   std::move(f).then([b = block](Any value) mutable {
-    b->value = std::move(value);
-
-    {
-      const std::lock_guard lk(b->mutex);
-      b->value_ready = true;
-    }
-
-    for(auto&& f : b->continuations) {
-      std::move(f)(b->value);
-    }
-    b->continuations.clear();
+    b->set_value(std::move(value));
     b = nullptr;
   });
 
@@ -8,9 +8,13 @@
 #include "ooze/result.h"
 #include "ooze/type.h"
 
+#include <functional>
+#include <memory>
+#include <optional>
 #include <span>
 #include <string>
 #include <string_view>
+#include <utility>
 #include <vector>
 
 namespace ooze {
@@ -32,6 +36,35 @@ enum class BindingState { Ready, Borrowed, NotReady };
 
 NativeRegistry create_primitive_registry();
 
+struct CompiledEnvData;
+
+// Immutable snapshot of the fns in an env, any number of threads can call them at once without copies or locks.
+// Changes made to the env afterwards aren't seen by it.
+class CompiledEnv {
+  std::shared_ptr<const CompiledEnvData> _data;
+
+public:
+  explicit CompiledEnv(std::shared_ptr<const CompiledEnvData>);
+
+  // Inputs taken by reference are passed as borrowed_inputs, each with the TypeID of its value which has to match the
+  // fn's. Overloaded fns are told apart by their type as printed by Env::pretty_print(), e.g. "fn(i32) -> i32".
+  StringResult<std::vector<Future>> call(Executor&,
+                                         std::string_view fn,
+                                         std::vector<std::pair<Future, TypeID>> inputs,
+                                         std::vector<std::pair<BorrowedFuture, TypeID>> borrowed_inputs = {},
+                                         std::string_view type = {}) const;
+
+  // Calls fn on each set of inputs pulled from source until it runs out, with up to window calls in flight. Outputs
+  // are passed to sink in the order their inputs were pulled. Returns once every call has been sunk, a set of inputs
+  // of the wrong types stops the stream with an error.
+  StringResult<void> stream(Executor&,
+                            std::string_view fn,
+                            int window,
+                            const std::function<std::optional<std::vector<Any>>()>& source,
+                            const std::function<void(std::vector<Any>)>& sink,
+                            std::string_view type = {}) const;
+};
+
 struct EnvData;
 
 class Env {
@@ -51,12 +84,20 @@ public:
   StringResult<void> parse_scripts(std::span<const std::string_view>) &;
   StringResult<void, Env> parse_scripts(std::span<const std::string_view>) &&;
 
+  // Compiled form of the parsed scripts so later runs can skip parsing them
+  StringResult<std::vector<std::byte>> serialize_scripts(std::span<const std::string_view>) const;
+
+  // Only succeeds for bytes from the same scripts and natives, otherwise the env is unchanged
+  StringResult<void> deserialize_scripts(std::span<const std::byte>, std::span<const std::string_view>) &;
+
   StringResult<Binding> run(Executor&, std::string_view) &;
   StringResult<Binding, Env> run(Executor&, std::string_view) &&;
 
   StringResult<Future> run_to_string(Executor&, std::string_view) &;
   StringResult<Future, Env> run_to_string(Executor&, std::string_view) &&;
 
+  CompiledEnv compile() const;
+
   bool drop(std::string_view);
 
   void insert(std::string_view, Binding);
@@ -67,6 +108,20 @@ public:
     return insert(name, Future(Any(std::move(value))), type_id<T>());
   }
 
+  // Replaces the binding, in reactive mode every binding assigned from it is then recomputed on the executor
+  StringResult<void> insert(Executor&, std::string_view, Binding);
+  StringResult<void> insert(Executor&, std::string_view, Future, TypeID);
+
+  template <typename T>
+  StringResult<void> insert(Executor& ex, std::string_view name, T value) {
+    return insert(ex, name, Future(Any(std::move(value))), type_id<T>());
+  }
+
+  // Off by default. When on, rebinding a binding by assignment or insert reruns the assignments of the bindings derived
+  // from it, leaving the rest as they are. Assignments rerun in the order they first ran and their side effects repeat.
+  void set_reactive(bool);
+  bool reactive() const;
+
   StringResult<void> type_check(std::string_view expr, std::string_view hint = "_") const;
   StringResult<void> type_check_fn(std::string_view) const;
 
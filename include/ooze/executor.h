@@ -3,17 +3,39 @@
 #include <tbb/task_arena.h>
 #include <tbb/task_group.h>
 
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <optional>
 
 namespace ooze {
 
+namespace details {
+
+// Arenas are shared process wide by thread count so executors don't pay for starting up workers each time
+inline tbb::task_arena& shared_arena(int num_threads) {
+  static std::mutex mutex;
+  static std::map<int, std::unique_ptr<tbb::task_arena>> arenas;
+
+  const std::lock_guard lock(mutex);
+  std::unique_ptr<tbb::task_arena>& arena = arenas[num_threads];
+  if(!arena) {
+    const int concurrency = num_threads == -1 ? tbb::task_arena::automatic : num_threads;
+    arena = std::make_unique<tbb::task_arena>(concurrency);
+    arena->initialize();
+  }
+  return *arena;
+}
+
+} // namespace details
+
 class Executor {
 public:
   Executor() = default;
 
-  Executor(int num_threads) : _tbb{std::in_place_t{}} {
-    _tbb->arena.initialize(num_threads == -1 ? tbb::task_arena::automatic : num_threads);
-  }
+  // Attaches to the shared arena with that many threads, wait() only waits on tasks run through this executor
+  Executor(int num_threads) : _tbb{std::in_place_t{}, details::shared_arena(num_threads)} {}
 
   Executor(const Executor&) = delete;
   Executor& operator=(const Executor&) = delete;
@@ -25,15 +47,30 @@ public:
   template <typename F>
   void run(F&& f) {
     if(_tbb) {
-      _tbb->arena.execute([&]() { _tbb->group.run(std::move(f)); });
+      _tbb->arena->execute([&]() { _tbb->group.run(std::move(f)); });
     } else {
       std::forward<F>(f)();
     }
   }
 
+  // Returns a callback that runs f on the executor, wait() doesn't return until it's been invoked. Lets work that is
+  // waiting on something outside the executor resume on it without holding a thread in the meantime.
+  template <typename F>
+  std::function<void()> defer(F&& f) {
+    if(_tbb) {
+      auto handle = std::make_shared<tbb::task_handle>();
+      _tbb->arena->execute([&]() { *handle = _tbb->group.defer(std::forward<F>(f)); });
+      return [tbb = &*_tbb, handle = std::move(handle)]() {
+        tbb->arena->execute([&]() { tbb->group.run(std::move(*handle)); });
+      };
+    } else {
+      return std::forward<F>(f);
+    }
+  }
+
   void wait() {
     if(_tbb) {
-      _tbb->arena.execute([&]() { _tbb->group.wait(); });
+      _tbb->arena->execute([&]() { _tbb->group.wait(); });
     }
   }
 
@@ -41,7 +78,9 @@ public:
 
 private:
   struct TBBExecutor {
-    tbb::task_arena arena;
+    explicit TBBExecutor(tbb::task_arena& arena) : arena(&arena) {}
+
+    tbb::task_arena* arena;
     tbb::task_group group;
   };
 
@@ -3,23 +3,184 @@
 #include "ooze/any.h"
 
 #include <atomic>
-#include <functional>
-#include <memory>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
 
 namespace ooze {
 
 inline bool decrement(std::atomic<int>& a) { return a.fetch_sub(1, std::memory_order_acq_rel) == 1; }
 inline bool ready(const std::atomic<int>& a) { return a.load(std::memory_order_acquire) == 0; }
 
+// Move-only void(Any) callable, small callables are stored inline
+class Continuation {
+  static constexpr size_t InlineSize = 6 * sizeof(void*);
+
+  template <typename F>
+  static constexpr bool stored_inline = sizeof(F) <= InlineSize && alignof(F) <= alignof(void*);
+
+  // Invokes the callable if given a value, then destroys it
+  template <typename F>
+  static void consume(Continuation& c, Any* value) {
+    if constexpr(stored_inline<F>) {
+      struct Destroy {
+        F* f;
+        ~Destroy() { f->~F(); }
+      } d{std::launder(reinterpret_cast<F*>(c._buffer))};
+
+      if(value) {
+        std::move (*d.f)(std::move(*value));
+      }
+    } else {
+      const std::unique_ptr<F> f(*std::launder(reinterpret_cast<F**>(c._buffer)));
+      if(value) {
+        std::move (*f)(std::move(*value));
+      }
+    }
+  }
+
+  alignas(void*) std::byte _buffer[InlineSize];
+  void (*_consume)(Continuation&, Any*) = nullptr;
+
+public:
+  Continuation() = default;
+  ~Continuation() { reset(); }
+
+  Continuation(const Continuation&) = delete;
+  Continuation& operator=(const Continuation&) = delete;
+
+  template <typename F>
+  void emplace(F&& f) {
+    using D = std::decay_t<F>;
+    reset();
+    if constexpr(stored_inline<D>) {
+      new(_buffer) D(std::forward<F>(f));
+    } else {
+      new(_buffer) D*(new D(std::forward<F>(f)));
+    }
+    _consume = consume<D>;
+  }
+
+  void operator()(Any value) { std::exchange(_consume, nullptr)(*this, &value); }
+
+  void reset() {
+    if(_consume) {
+      std::exchange(_consume, nullptr)(*this, nullptr);
+    }
+  }
+
+  explicit operator bool() const { return _consume != nullptr; }
+};
+
+// Intrusively ref counted state shared by a Promise and a Future
 struct SharedBlock {
   Any value;
-  std::optional<std::function<void(Any)>> continuation;
-  std::atomic<int> value_ready;
+  Continuation continuation;
+  std::atomic<int> value_ready = 0;
+  std::atomic<int> ref_count = 0;
+  SharedBlock* next_free = nullptr;
+};
+
+namespace details {
+
+// Blocks are recycled through a free list per thread, they go back to whichever thread drops the last reference
+class SharedBlockPool {
+  static constexpr int MaxSize = 1024;
+
+  SharedBlock* _head = nullptr;
+  int _size = 0;
+
+  // Trivially destructible so it can still be checked by blocks released after the pool is gone
+  static bool& closed() {
+    thread_local bool closed = false;
+    return closed;
+  }
+
+  static SharedBlockPool* pool() {
+    thread_local SharedBlockPool pool;
+    return closed() ? nullptr : &pool;
+  }
+
+public:
+  SharedBlockPool() = default;
+  SharedBlockPool(const SharedBlockPool&) = delete;
+  SharedBlockPool& operator=(const SharedBlockPool&) = delete;
+
+  ~SharedBlockPool() {
+    closed() = true;
+    while(_head) {
+      delete std::exchange(_head, _head->next_free);
+    }
+  }
+
+  static SharedBlock* acquire(Any value, int value_ready, int ref_count) {
+    SharedBlockPool* p = pool();
 
-  SharedBlock(Any value, int ref_count = 0) : value(std::move(value)), value_ready(ref_count) {}
-  SharedBlock() : SharedBlock(Any{}, 1) {}
+    SharedBlock* b = nullptr;
+    if(p && p->_head) {
+      b = std::exchange(p->_head, p->_head->next_free);
+      p->_size--;
+    } else {
+      b = new SharedBlock();
+    }
+
+    b->value = std::move(value);
+    b->value_ready.store(value_ready, std::memory_order_relaxed);
+    b->ref_count.store(ref_count, std::memory_order_relaxed);
+    b->next_free = nullptr;
+    return b;
+  }
+
+  static void release(SharedBlock* b) {
+    // Either of these can drop the last reference to other blocks
+    b->value = Any{};
+    b->continuation.reset();
+
+    SharedBlockPool* p = pool();
+    if(p && p->_size < MaxSize) {
+      b->next_free = p->_head;
+      p->_head = b;
+      p->_size++;
+    } else {
+      delete b;
+    }
+  }
+};
+
+class SharedBlockRef {
+  SharedBlock* _block = nullptr;
+
+public:
+  SharedBlockRef() = default;
+  explicit SharedBlockRef(SharedBlock* block) : _block(block) {}
+
+  SharedBlockRef(const SharedBlockRef&) = delete;
+  SharedBlockRef& operator=(const SharedBlockRef&) = delete;
+
+  SharedBlockRef(SharedBlockRef&& r) noexcept : _block(std::exchange(r._block, nullptr)) {}
+
+  SharedBlockRef& operator=(SharedBlockRef&& r) noexcept {
+    SharedBlock* block = std::exchange(r._block, nullptr);
+    reset();
+    _block = block;
+    return *this;
+  }
+
+  ~SharedBlockRef() { reset(); }
+
+  void reset() {
+    if(SharedBlock* b = std::exchange(_block, nullptr); b && decrement(b->ref_count)) {
+      SharedBlockPool::release(b);
+    }
+  }
+
+  SharedBlock* operator->() const { return _block; }
+  explicit operator bool() const { return _block != nullptr; }
 };
 
+} // namespace details
+
 class Future;
 class Promise;
 
@@ -39,29 +200,29 @@ public:
     _block->value = std::move(value);
     if(decrement(_block->value_ready)) {
       if(_block->continuation) {
-        std::move (*_block->continuation)(std::move(_block->value));
+        _block->continuation(std::move(_block->value));
       }
     }
 
-    _block = nullptr;
+    _block.reset();
   }
 
-  explicit operator bool() const { return _block != nullptr; }
+  explicit operator bool() const { return static_cast<bool>(_block); }
   bool valid() const { return static_cast<bool>(*this); }
 
 private:
-  std::shared_ptr<SharedBlock> _block;
+  details::SharedBlockRef _block;
 
   friend std::pair<Promise, Future> make_promise_future();
 
-  Promise(std::shared_ptr<SharedBlock> block) : _block(std::move(block)) {}
+  Promise(details::SharedBlockRef block) : _block(std::move(block)) {}
 };
 
 class Future {
 public:
   Future() = default;
 
-  explicit Future(Any value) : _block(std::make_shared<SharedBlock>(std::move(value))) {}
+  explicit Future(Any value) : _block(details::SharedBlockPool::acquire(std::move(value), 0, 1)) {}
 
   Future(Future&&) = default;
   Future& operator=(Future&&) = default;
@@ -73,74 +234,57 @@ public:
     if(_block->value_ready.fetch_add(1, std::memory_order_acquire) == 0) {
       std::move(f)(std::move(_block->value));
     } else {
-      _block->continuation = std::move(f);
+      _block->continuation.emplace(std::move(f));
 
       if(decrement(_block->value_ready)) {
-        std::move (*_block->continuation)(std::move(_block->value));
+        _block->continuation(std::move(_block->value));
       }
     }
 
-    _block = nullptr;
+    _block.reset();
   }
 
   template <typename F, typename = std::enable_if_t<!std::is_same_v<void, std::invoke_result_t<F, Any>>>>
   Future then(F f) && {
     auto [p, new_future] = make_promise_future();
 
-    if(_block->value_ready.fetch_add(1, std::memory_order_acquire) == 0) {
-      std::move(p).send(std::move(f)(std::move(_block->value)));
-    } else {
-      // std::function requires copyable callables...
-      auto shared_p = std::make_shared<Promise>(std::move(p));
-      _block->continuation = [f = std::move(f), p = std::move(shared_p)](Any value) mutable {
-        std::move(*p).send(std::move(f)(std::move(value)));
-      };
-
-      if(decrement(_block->value_ready)) {
-        std::move (*_block->continuation)(std::move(_block->value));
-      }
-    }
+    std::move(*this).then([f = std::move(f), p = std::move(p)](Any value) mutable {
+      std::move(p).send(std::move(f)(std::move(value)));
+    });
 
-    _block = nullptr;
     return std::move(new_future);
   }
 
-  explicit operator bool() const { return _block != nullptr; }
+  explicit operator bool() const { return static_cast<bool>(_block); }
   bool valid() const { return static_cast<bool>(*this); }
 
 private:
-  std::shared_ptr<SharedBlock> _block;
+  details::SharedBlockRef _block;
 
   friend std::pair<Promise, Future> make_promise_future();
 
-  Future(std::shared_ptr<SharedBlock> block) : _block(std::move(block)) {}
+  Future(details::SharedBlockRef block) : _block(std::move(block)) {}
 };
 
 inline std::pair<Promise, Future> make_promise_future() {
-  auto block = std::make_shared<SharedBlock>();
-  return {Promise(block), Future(std::move(block))};
+  SharedBlock* block = details::SharedBlockPool::acquire(Any{}, 1, 2);
+  return {Promise(details::SharedBlockRef(block)), Future(details::SharedBlockRef(block))};
 }
 
 inline std::pair<Future, Future> clone(Future f) {
   auto [p1, f1] = make_promise_future();
   auto [p2, f2] = make_promise_future();
 
-  auto ptr = new std::pair(std::move(p1), std::move(p2));
-
-  std::move(f).then([ptr](Any a) mutable {
-    std::move(ptr->first).send(a);
-    std::move(ptr->second).send(std::move(a));
-    delete ptr;
+  std::move(f).then([p1 = std::move(p1), p2 = std::move(p2)](Any a) mutable {
+    std::move(p1).send(a);
+    std::move(p2).send(std::move(a));
   });
 
   return {std::move(f1), std::move(f2)};
 }
 
 inline void connect(Future f, Promise p) {
-  std::move(f).then([p = new Promise(std::move(p))](Any a) mutable {
-    std::move(*p).send(std::move(a));
-    delete p;
-  });
+  std::move(f).then([p = std::move(p)](Any a) mutable { std::move(p).send(std::move(a)); });
 }
 
 } // namespace ooze
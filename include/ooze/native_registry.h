@@ -1,35 +1,88 @@
 #pragma once
 
 #include "ooze/any_fn.h"
+#include "ooze/future.h"
+#include "ooze/parallel.h"
 #include "ooze/type.h"
 
+#include <algorithm>
 #include <cassert>
+#include <mutex>
 #include <optional>
 #include <string>
 #include <type_traits>
+#include <utility>
 #include <vector>
 
 namespace ooze {
 
+// Hint of how expensive a fn is to execute, used to decide whether it's worth spawning a task for.
+// Unknown fns are timed at runtime.
+enum class Cost { Unknown, Cheap, Expensive };
+
+constexpr auto names(knot::Type<Cost>) { return knot::Names("Cost", {"Unknown", "Cheap", "Expensive"}); }
+
+// Pure fns always return the same outputs for the same inputs and do nothing else, so identical calls are merged and
+// calls on constants are evaluated when scripts are compiled.
+// Calls whose outputs go unused are removed unless the fn is impure or returns nothing.
+enum class Purity { Unknown, Pure, Impure };
+
+constexpr auto names(knot::Type<Purity>) { return knot::Names("Purity", {"Unknown", "Pure", "Impure"}); }
+
 struct NativeFn {
   Type type;
   std::string name;
   AnyFn fn;
+  Cost cost = Cost::Unknown;
+  Purity purity = Purity::Unknown;
+
+  // Outputs a Future of its result instead of the result, the runtime waits on it without holding a thread
+  bool async = false;
 };
 
+namespace details {
+
+template <typename R, typename... Ts>
+Type add_async_fn_type(TypeGraph& tg, knot::TypeList<Ts...>) {
+  return add_fn_type(tg, knot::Type<R (*)(Ts...)>{});
+}
+
+} // namespace details
+
 struct NativeRegistry {
   TypeGraph tg;
   NativeTypeInfo types;
   std::vector<NativeFn> fns;
 
   template <typename F>
-  void add_fn(std::string name, F&& f) & {
-    fns.push_back({add_fn_type(tg, decay(knot::Type<F>{})), std::move(name), create_any_fn(std::forward<F>(f))});
+  void add_fn(std::string name, F&& f, Cost cost = Cost::Unknown, Purity purity = Purity::Unknown) & {
+    fns.push_back(
+      {add_fn_type(tg, decay(knot::Type<F>{})), std::move(name), create_any_fn(std::forward<F>(f)), cost, purity});
   }
 
   template <typename F>
-  NativeRegistry&& add_fn(std::string name, F&& f) && {
-    add_fn(std::move(name), std::forward<F>(f));
+  NativeRegistry&& add_fn(std::string name, F&& f, Cost cost = Cost::Unknown, Purity purity = Purity::Unknown) && {
+    add_fn(std::move(name), std::forward<F>(f), cost, purity);
+    return std::move(*this);
+  }
+
+  // Adds a fn returning a Future that is fulfilled with an R, which may happen on any thread
+  template <typename R, typename F>
+  void add_async_fn(std::string name, F&& f, Cost cost = Cost::Unknown, Purity purity = Purity::Unknown) & {
+    static_assert(return_type(decay(knot::Type<F>{})) == knot::Type<Future>{}, "Async fns must return a Future.");
+    static_assert(!is_tuple(knot::Type<R>{}), "Async fns can only be fulfilled with a single output.");
+    fns.push_back({details::add_async_fn_type<R>(tg, args(decay(knot::Type<F>{}))),
+                   std::move(name),
+                   create_any_fn(std::forward<F>(f)),
+                   cost,
+                   purity,
+                   true});
+  }
+
+  template <typename R, typename F>
+  NativeRegistry&&
+  add_async_fn(std::string name, F&& f, Cost cost = Cost::Unknown, Purity purity = Purity::Unknown) && {
+    add_async_fn<R>(std::move(name), std::forward<F>(f), cost, purity);
     return std::move(*this);
   }
 
@@ -46,7 +99,7 @@ struct NativeRegistry {
     }
 
     if constexpr(std::is_copy_constructible_v<T>) {
-      std::move(*this).add_fn("clone", [](const T& t) { return t; });
+      std::move(*this).add_fn("clone", [](const T& t) { return t; }, Cost::Unknown, Purity::Pure);
     }
 
     insert(types.names, std::string(name), type);
@@ -57,6 +110,94 @@ struct NativeRegistry {
     add_type<T>(std::move(name), copy_override);
     return std::move(*this);
   }
+
+  // Adds par_map, par_reduce and par_for_range over std::vector<T>. They call a fn value on every element, spread
+  // across the executor in chunks. par_reduce expects an associative fn and an init that is its identity.
+  template <typename T>
+  void add_parallel_fns() & {
+    static_assert(std::is_copy_constructible_v<T>, "par_reduce starts every chunk from a copy of init");
+
+    const auto fn_type = [&](std::vector<Type> args, Type result) {
+      return tg.add_node(std::array{tg.add_node(args, TypeTag::Tuple, TypeID{}), result}, TypeTag::Fn, TypeID{});
+    };
+
+    const Type t = ooze::add_type(tg, knot::Type<T>{});
+    const Type vec = ooze::add_type(tg, knot::Type<std::vector<T>>{});
+    const Type i32 = ooze::add_type(tg, knot::Type<int>{});
+
+    // Fn values may do anything so calls are never merged or removed
+    fns.push_back({fn_type({fn_type({t}, t), vec}, vec),
+                   "par_map",
+                   [](std::span<Any> inputs, std::span<const Any*>, Any* outputs) {
+                     std::vector<T>& xs = any_cast<std::vector<T>>(inputs[1]);
+                     for_each_chunk(int(xs.size()), [&](int begin, int end) {
+                       for(int i = begin; i < end; i++) {
+                         Any x(std::move(xs[i]));
+                         Any y;
+                         call_fn_value(inputs[0], {&x, 1}, {}, &y);
+                         xs[i] = std::move(any_cast<T>(y));
+                       }
+                     });
+                     outputs[0] = std::move(inputs[1]);
+                   },
+                   Cost::Expensive,
+                   Purity::Impure});
+
+    fns.push_back({fn_type({fn_type({t, t}, t), vec, t}, t),
+                   "par_reduce",
+                   [](std::span<Any> inputs, std::span<const Any*>, Any* outputs) {
+                     std::vector<T>& xs = any_cast<std::vector<T>>(inputs[1]);
+
+                     // Chunks finish in any order, they're combined by where they start
+                     std::mutex mutex;
+                     std::vector<std::pair<int, Any>> partials;
+                     for_each_chunk(int(xs.size()), [&](int begin, int end) {
+                       Any acc = inputs[2];
+                       for(int i = begin; i < end; i++) {
+                         std::array<Any, 2> args{std::move(acc), Any(std::move(xs[i]))};
+                         call_fn_value(inputs[0], args, {}, &acc);
+                       }
+                       const std::lock_guard lock(mutex);
+                       partials.emplace_back(begin, std::move(acc));
+                     });
+
+                     std::sort(partials.begin(), partials.end(), [](const auto& x, const auto& y) {
+                       return x.first < y.first;
+                     });
+
+                     outputs[0] = std::move(inputs[2]);
+                     for(auto& [begin, partial] : partials) {
+                       std::array<Any, 2> args{std::move(outputs[0]), std::move(partial)};
+                       call_fn_value(inputs[0], args, {}, outputs);
+                     }
+                   },
+                   Cost::Expensive,
+                   Purity::Impure});
+
+    fns.push_back({fn_type({fn_type({i32}, t), i32, i32}, vec),
+                   "par_for_range",
+                   [](std::span<Any> inputs, std::span<const Any*>, Any* outputs) {
+                     const int first = any_cast<int>(inputs[1]);
+                     std::vector<T> ys(std::max(0, any_cast<int>(inputs[2]) - first));
+                     for_each_chunk(int(ys.size()), [&](int begin, int end) {
+                       for(int i = begin; i < end; i++) {
+                         Any x(first + i);
+                         Any y;
+                         call_fn_value(inputs[0], {&x, 1}, {}, &y);
+                         ys[i] = std::move(any_cast<T>(y));
+                       }
+                     });
+                     outputs[0] = Any(std::move(ys));
+                   },
+                   Cost::Expensive,
+                   Purity::Impure});
+  }
+
+  template <typename T>
+  NativeRegistry&& add_parallel_fns() && {
+    add_parallel_fns<T>();
+    return std::move(*this);
+  }
 };
 
 } // namespace ooze
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "ooze/any.h"
+
+#include <functional>
+#include <span>
+
+namespace ooze {
+
+// Calls a fn value passed to a native, on the program running that native. Only valid from within a native.
+// The call runs to completion on this thread before returning.
+void call_fn_value(const Any& fn, std::span<Any> inputs, std::span<const Any*> borrowed_inputs, Any* outputs);
+
+// Runs body over consecutive chunks covering [0, size), split across the executor running the current native if it's
+// parallel. Only valid from within a native.
+void for_each_chunk(int size, const std::function<void(int begin, int end)>& body);
+
+} // namespace ooze
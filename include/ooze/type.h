@@ -5,8 +5,12 @@
 #include "ooze/traits.h"
 
 #include <algorithm>
+#include <cassert>
 #include <numeric>
+#include <optional>
+#include <span>
 #include <string>
+#include <unordered_map>
 #include <unordered_set>
 #include <utility>
 #include <vector>
@@ -48,7 +52,130 @@ enum class TypeTag { Leaf, Floating, Borrow, Fn, Tuple };
 
 constexpr auto names(knot::Type<TypeTag>) { return knot::Names("Type", {"Leaf", "Floating", "Borrow", "Fn", "Tuple"}); }
 
-using TypeGraph = Graph<Type, TypeTag, TypeID>;
+// Structurally identical types are only added once so they can be compared by id. Leaves parsed from a type name
+// are the exception, they stay distinct until the name is resolved and canonical_nodes() maps them to their twins.
+class TypeGraph : public Graph<Type, TypeTag, TypeID> {
+  using Base = Graph<Type, TypeTag, TypeID>;
+
+  std::unordered_multimap<size_t, Type> _interned;
+
+  static size_t hash(std::span<const Type> fanout, TypeTag tag, TypeID id) {
+    size_t h = std::hash<TypeID>{}(id) ^ (size_t(tag) << 1);
+    for(const Type t : fanout) {
+      h ^= std::hash<i32>{}(t.get()) + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+    }
+    return h;
+  }
+
+  static bool is_unnamed_leaf(TypeTag tag, TypeID id) { return tag == TypeTag::Leaf && id == TypeID{}; }
+
+  std::optional<Type> find(size_t h, std::span<const Type> fanout, TypeTag tag, TypeID id) const {
+    const auto [begin, end] = _interned.equal_range(h);
+    for(auto it = begin; it != end; ++it) {
+      const Type t = it->second;
+      const auto t_fanout = Base::fanout(t);
+      if(get<TypeTag>(t) == tag && get<TypeID>(t) == id &&
+         std::equal(t_fanout.begin(), t_fanout.end(), fanout.begin(), fanout.end())) {
+        return t;
+      }
+    }
+    return std::nullopt;
+  }
+
+  void intern(Type t) {
+    const TypeTag tag = get<TypeTag>(t);
+    const TypeID id = get<TypeID>(t);
+    const size_t h = hash(Base::fanout(t), tag, id);
+    if(!is_unnamed_leaf(tag, id) && !find(h, Base::fanout(t), tag, id)) {
+      _interned.emplace(h, t);
+    }
+  }
+
+public:
+  TypeGraph() = default;
+
+  // Duplicates within the given graph are kept as is so existing ids stay valid
+  TypeGraph(Base g) : Base(std::move(g)) {
+    for(const Type t : nodes()) {
+      intern(t);
+    }
+  }
+
+  Type add_node(std::span<const Type> fanout, TypeTag tag, TypeID id) {
+    const size_t h = hash(fanout, tag, id);
+    if(const auto existing = find(h, fanout, tag, id); existing) {
+      return *existing;
+    }
+
+    const Type t = Base::add_node(fanout, tag, id);
+    _interned.emplace(h, t);
+    return t;
+  }
+
+  Type add_node(TypeTag tag, TypeID id) { return add_node(std::span<const Type>{}, tag, id); }
+
+  Type add_unnamed_leaf() { return Base::add_node(TypeTag::Leaf, TypeID{}); }
+
+  void name_leaf(Type t, TypeID id) {
+    assert(is_unnamed_leaf(get<TypeTag>(t), get<TypeID>(t)));
+    Base::set<TypeID>(t, id);
+    intern(t);
+  }
+
+  // Named leaves from `first` on can duplicate existing nodes, as can everything built on them. Returns the node to
+  // use in place of each node, adding canonical parents where none exist yet.
+  std::vector<Type> canonical_nodes(Type first) {
+    const int size = num_nodes();
+    std::vector<Type> canonical;
+    canonical.reserve(size);
+    for(int i = 0; i < size; i++) {
+      canonical.push_back(Type(i));
+    }
+
+    std::vector<Type> fanout;
+    for(int i = first.get(); i < size; i++) {
+      const Type t = Type(i);
+      const TypeTag tag = get<TypeTag>(t);
+      const TypeID id = get<TypeID>(t);
+      if(is_unnamed_leaf(tag, id)) {
+        continue;
+      }
+
+      fanout.clear();
+      bool changed = false;
+      for(const Type f : Base::fanout(t)) {
+        fanout.push_back(canonical[f.get()]);
+        changed |= fanout.back() != f;
+      }
+
+      if(const auto existing = find(hash(fanout, tag, id), fanout, tag, id); existing) {
+        canonical[i] = *existing;
+      } else if(changed) {
+        canonical[i] = add_node(fanout, tag, id);
+      }
+    }
+
+    return canonical;
+  }
+
+  void pop_node() {
+    const Type last = Type(num_nodes() - 1);
+    const auto [begin, end] = _interned.equal_range(hash(Base::fanout(last), get<TypeTag>(last), get<TypeID>(last)));
+    if(const auto it = std::find_if(begin, end, [&](const auto& p) { return p.second == last; }); it != end) {
+      _interned.erase(it);
+    }
+    Base::pop_node();
+  }
+
+  void add_fanout_to_last_node(Type) = delete;
+
+  template <typename T>
+  void set(Type, T) = delete;
+
+  friend bool operator==(const TypeGraph& x, const TypeGraph& y) {
+    return static_cast<const Base&>(x) == static_cast<const Base&>(y);
+  }
+};
 
 using TypeNames = std::vector<std::pair<std::string, TypeID>>;
 
@@ -2,18 +2,19 @@
 
 #include <cstdlib>
 #include <iostream>
+#include <numeric>
 #include <string>
 
 namespace {
 
 ooze::NativeRegistry create_registry() {
   return ooze::create_primitive_registry()
-    .add_fn("add", [](int x, int y) { return x + y; })
-    .add_fn("add", [](int x, int y, int z) { return x + y + z; })
-    .add_fn("add", [](int w, int x, int y, int z) { return w + x + y + z; })
-    .add_fn("sub", [](int x, int y) { return x - y; })
-    .add_fn("le", [](int x, int y) { return x <= y; })
-    .add_fn("eq", [](int x, int y) { return x == y; })
+    .add_fn("add", [](int x, int y) { return x + y; }, ooze::Cost::Cheap, ooze::Purity::Pure)
+    .add_fn("add", [](int x, int y, int z) { return x + y + z; }, ooze::Cost::Cheap, ooze::Purity::Pure)
+    .add_fn("add", [](int w, int x, int y, int z) { return w + x + y + z; }, ooze::Cost::Cheap, ooze::Purity::Pure)
+    .add_fn("sub", [](int x, int y) { return x - y; }, ooze::Cost::Cheap, ooze::Purity::Pure)
+    .add_fn("le", [](int x, int y) { return x <= y; }, ooze::Cost::Cheap, ooze::Purity::Pure)
+    .add_fn("eq", [](int x, int y) { return x == y; }, ooze::Cost::Cheap, ooze::Purity::Pure)
     .add_fn("len", [](const std::string& x) { return int(x.size()); })
     .add_fn("len", [](const std::vector<std::string>& v) { return int(v.size()); })
     .add_fn("assert_eq",
@@ -22,9 +23,20 @@ ooze::NativeRegistry create_registry() {
                 std::cerr << "Expected: " << exp << " Actual: " << act << "\n";
               }
               return exp == act ? EXIT_SUCCESS : EXIT_FAILURE;
-            })
+            },
+            ooze::Cost::Unknown,
+            ooze::Purity::Impure)
     .add_fn("get", [](const std::vector<std::string>& v, int idx) { return v[idx]; })
-    .add_fn("stoi", [](const std::string& x) { return std::stoi(x); });
+    .add_fn("stoi", [](const std::string& x) { return std::stoi(x); })
+    .add_type<std::vector<int>>("i32_vector")
+    .add_fn("iota",
+            [](int n) {
+              std::vector<int> v(n);
+              std::iota(v.begin(), v.end(), 0);
+              return v;
+            })
+    .add_fn("len", [](const std::vector<int>& v) { return int(v.size()); })
+    .add_parallel_fns<int>();
 }
 
 } // namespace
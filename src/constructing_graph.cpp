@@ -61,6 +61,57 @@ auto find_borrow_cleanups(std::vector<std::vector<ValueForward>> fwds) {
   return std::tuple(std::move(cleanups), std::move(node_borrows), std::move(fwds));
 }
 
+// Re-adds the kept nodes and outputs of a graph to a new one with the same inputs, some of which may now be borrowed
+FunctionGraph rebuild(const FunctionGraph& g,
+                      std::vector<bool> input_borrows,
+                      const std::vector<bool>& kept_nodes,
+                      const std::vector<bool>& kept_outputs) {
+  const std::vector<NodeInputs> node_inputs = find_node_inputs(g);
+
+  auto [cg, graph_inputs] = make_graph(std::move(input_borrows));
+
+  // Oterms in the new graph of the outputs of every node of the old one, inputs come first
+  std::vector<std::vector<Oterm>> outputs(g.insts.size() + 1);
+  std::vector<Oterm> borrowed_inputs;
+  for(int i = 0; i < std::ssize(graph_inputs); i++) {
+    (g.input_borrows[i] ? borrowed_inputs : outputs[0]).push_back(graph_inputs[i]);
+  }
+
+  const auto new_oterm = [&](Oterm old) {
+    return old.borrow ? borrowed_inputs[old.term.port] : outputs[old.term.node_id][old.term.port];
+  };
+
+  for(int n = 0; n < std::ssize(g.insts); n++) {
+    if(kept_nodes[n]) {
+      const NodeInputs& inputs = node_inputs[n];
+
+      std::vector<Oterm> terms;
+      std::vector<PassBy> pass_bys;
+      for(const auto& [oterm, pb] : inputs.owned) {
+        terms.push_back(new_oterm(oterm));
+        pass_bys.push_back(pb);
+      }
+      for(const auto& [oterm, pb] : inputs.borrowed) {
+        terms.push_back(new_oterm(oterm));
+        pass_bys.push_back(pb);
+      }
+
+      outputs[n + 1] = cg.add(g.insts[n], terms, pass_bys, int(g.owned_fwds[n + 1].size()));
+    }
+  }
+
+  std::vector<Oterm> terms;
+  std::vector<PassBy> pass_bys;
+  for(int i = 0; i < g.output_count; i++) {
+    if(kept_outputs[i]) {
+      terms.push_back(new_oterm(node_inputs.back().owned[i].first));
+      pass_bys.push_back(node_inputs.back().owned[i].second);
+    }
+  }
+
+  return std::move(cg).finalize(terms, pass_bys);
+}
+
 } // namespace
 
 std::vector<Iterm>& ConstructingGraph::fwd_of(Oterm o) {
@@ -184,6 +235,77 @@ std::tuple<ConstructingGraph, std::vector<Oterm>> make_graph(std::vector<bool> i
   return {ConstructingGraph{std::move(input_borrows)}, std::move(terms)};
 }
 
+std::vector<NodeInputs> find_node_inputs(const FunctionGraph& g) {
+  std::vector<NodeInputs> inputs(g.insts.size() + 1);
+
+  const auto add_fwd = [&](Oterm src, const ValueForward& fwd) {
+    for(int u = 0; u < std::ssize(fwd.terms); u++) {
+      const Term t = fwd.terms[u];
+      const PassBy pb = u < fwd.copy_end ? PassBy::Copy : (u < fwd.move_end ? PassBy::Move : PassBy::Borrow);
+      auto& ports = pb == PassBy::Borrow ? inputs[t.node_id].borrowed : inputs[t.node_id].owned;
+      if(ports.size() <= t.port) {
+        ports.resize(t.port + 1);
+      }
+      ports[t.port] = {src, pb};
+    }
+  };
+
+  for(int node = 0; node < std::ssize(g.owned_fwds); node++) {
+    for(int port = 0; port < std::ssize(g.owned_fwds[node]); port++) {
+      add_fwd(Oterm{node, port, false}, g.owned_fwds[node][port]);
+    }
+  }
+
+  for(int port = 0; port < std::ssize(g.input_borrowed_fwds); port++) {
+    add_fwd(Oterm{0, port, true}, g.input_borrowed_fwds[port]);
+  }
+
+  return inputs;
+}
+
+FunctionGraph
+prune(FunctionGraph g, const std::vector<bool>& kept_outputs, const std::function<bool(Inst)>& always_run) {
+  assert(kept_outputs.size() == g.output_count);
+
+  const int output_node = int(g.insts.size());
+
+  // Nodes only ever depend on nodes added before them, so walking backwards visits consumers first
+  std::vector<bool> live(g.insts.size(), false);
+  const auto consumed = [&](const ValueForward& fwd) {
+    return stdr::any_of(
+      fwd.terms, [&](Term t) { return t.node_id == output_node ? kept_outputs[t.port] : live[t.node_id]; });
+  };
+
+  for(int n = output_node - 1; n >= 0; n--) {
+    live[n] = always_run(g.insts[n]) || stdr::any_of(g.owned_fwds[n + 1], consumed);
+  }
+
+  if(stdr::all_of(live, Identity{}) && stdr::all_of(kept_outputs, Identity{})) {
+    return g;
+  }
+
+  return rebuild(g, g.input_borrows, live, kept_outputs);
+}
+
+FunctionGraph borrow_unmoved_inputs(FunctionGraph g, const std::vector<bool>& candidates) {
+  assert(candidates.size() == g.input_borrows.size());
+
+  std::vector<bool> input_borrows = g.input_borrows;
+
+  int value_idx = 0;
+  for(int i = 0; i < std::ssize(input_borrows); i++) {
+    if(!g.input_borrows[i]) {
+      const ValueForward& fwd = g.owned_fwds[0][value_idx++];
+      input_borrows[i] = candidates[i] && fwd.copy_end == fwd.move_end;
+    }
+  }
+
+  return input_borrows == g.input_borrows
+           ? g
+           : rebuild(g, std::move(input_borrows), std::vector<bool>(g.insts.size(), true),
+                     std::vector<bool>(g.output_count, true));
+}
+
 ConstructingGraph::ConstructingGraph(std::vector<bool> input_borrows_) : input_borrows{std::move(input_borrows_)} {
   auto [value_count, borrow_count] = counts(input_borrows);
   owned_fwds.emplace_back(value_count);
@@ -3,6 +3,8 @@
 #include "function_graph.h"
 #include "inst.h"
 
+#include <functional>
+
 namespace ooze {
 
 enum class PassBy { Copy, Move, Borrow };
@@ -46,4 +48,19 @@ public:
 
 std::tuple<ConstructingGraph, std::vector<Oterm>> make_graph(std::vector<bool> input_borrows);
 
+// Inputs of a node rebuilt from the forwards of its producers, owned ports followed by borrowed ports
+struct NodeInputs {
+  std::vector<std::pair<Oterm, PassBy>> owned;
+  std::vector<std::pair<Oterm, PassBy>> borrowed;
+};
+
+// Indexed by node with the graph output last
+std::vector<NodeInputs> find_node_inputs(const FunctionGraph&);
+
+// Removes every node that none of the kept outputs depend on unless it must always run, only the kept outputs remain
+FunctionGraph prune(FunctionGraph, const std::vector<bool>& kept_outputs, const std::function<bool(Inst)>& always_run);
+
+// Turns the candidate owned inputs that are never moved into borrowed inputs, copies of them are made from the borrow
+FunctionGraph borrow_unmoved_inputs(FunctionGraph, const std::vector<bool>& candidates);
+
 } // namespace ooze
@@ -6,6 +6,7 @@
 
 #include <knot/core.h>
 
+#include <cassert>
 #include <numeric>
 #include <type_traits>
 #include <vector>
@@ -85,12 +86,14 @@ class Forest {
     }
   };
 
+public:
   struct Connectivity {
     ID parent = INVALID;
     ID next_sibling = INVALID;
     ID first_child = INVALID;
   };
 
+private:
   std::vector<T> _values;
   std::vector<Connectivity> _connectivity;
   ID _first_root = INVALID;
@@ -150,6 +153,14 @@ public:
     std::transform(other._values.begin(), other._values.end(), std::back_inserter(_values), f);
   }
 
+  // Rebuilds a forest exactly as given, used when deserializing
+  Forest(std::vector<T> values, std::vector<Connectivity> connectivity, ID first_root)
+      : _values(std::move(values)), _connectivity(std::move(connectivity)), _first_root(first_root) {
+    assert(_values.size() == _connectivity.size());
+  }
+
+  const std::vector<Connectivity>& connectivity() const { return _connectivity; }
+
   const T& operator[](ID id) const { return _values[as_integral(id)]; }
   T& operator[](ID id) { return _values[as_integral(id)]; }
 
@@ -263,6 +274,31 @@ public:
     _connectivity[as_integral(child)].parent = parent == ABOVE_ROOTS ? INVALID : parent;
   }
 
+  // Removes every node from size onwards, none of the remaining nodes can be beneath them
+  void truncate(ID size) {
+    const auto removed = [&](ID id) { return id != INVALID && as_integral(id) >= as_integral(size); };
+
+    const auto unlink = [&](ID* slot) {
+      while(*slot != INVALID) {
+        if(removed(*slot)) {
+          *slot = _connectivity[as_integral(*slot)].next_sibling;
+        } else {
+          slot = &_connectivity[as_integral(*slot)].next_sibling;
+        }
+      }
+    };
+
+    unlink(&_first_root);
+    for(auto i = as_integral(size); i < ssize(); i++) {
+      if(const ID parent = _connectivity[i].parent; parent != INVALID && !removed(parent)) {
+        unlink(&_connectivity[as_integral(parent)].first_child);
+      }
+    }
+
+    _values.erase(_values.begin() + as_integral(size), _values.end());
+    _connectivity.erase(_connectivity.begin() + as_integral(size), _connectivity.end());
+  }
+
   template <typename IDs>
   ID append_root_post_order(T value, const IDs& ids) {
     const ID id = append_child(ABOVE_ROOTS, std::move(value));
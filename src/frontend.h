@@ -8,11 +8,12 @@ namespace ooze {
 template <typename T>
 ContextualResult<T, AST>
 type_name_resolution(Span<std::string_view> srcs, const TypeNames& names, ParserResult<T> pr, AST ast) {
-  return type_name_resolution(srcs, names, pr.type_srcs, std::move(ast.tg))
-    .map([&](TypeGraph tg) { return std::tuple(std::move(pr.parsed), std::move(tg)); })
-    .map_state([&](TypeGraph tg) {
-      ast.tg = std::move(tg);
-      return ast;
+  return type_name_resolution(srcs, names, pr.type_srcs, std::move(ast))
+    .map([&](std::vector<Type> canonical, AST ast) {
+      if constexpr(std::is_same_v<T, Type>) {
+        pr.parsed = canonical[pr.parsed.get()];
+      }
+      return std::tuple(std::move(pr.parsed), std::move(ast));
     });
 }
 
@@ -3,6 +3,8 @@
 #include "constructing_graph.h"
 #include "function_graph_construction.h"
 
+#include <map>
+
 namespace ooze {
 
 namespace {
@@ -449,8 +451,269 @@ std::vector<ContextualError> find_borrow_move_dependency_errors(
   return errors;
 }
 
+// Script fn an inst evaluates to when called, with any values curried onto it
+std::optional<std::pair<Inst, std::vector<Any>>> find_callee_graph(const Program& p, Inst inst) {
+  const Program& owner = p.owner(inst);
+  const i32 idx = owner.index(inst);
+
+  if(owner.inst[idx] == InstOp::Graph) {
+    return std::pair(inst, std::vector<Any>{});
+  } else if(owner.inst[idx] == InstOp::Curry) {
+    const auto [curried, slice] = owner.currys[owner.inst_data[idx]];
+    const Program& curried_owner = p.owner(curried);
+    if(curried_owner.inst[curried_owner.index(curried)] == InstOp::Graph) {
+      return std::pair(curried,
+                       std::vector<Any>(owner.values.begin() + slice.begin, owner.values.begin() + slice.end));
+    }
+  }
+
+  return std::nullopt;
+}
+
+const FunctionGraph& graph_of(const Program& p, Inst inst) {
+  const Program& owner = p.owner(inst);
+  return owner.graphs[owner.inst_data[owner.index(inst)]];
+}
+
+// Inputs forwarded straight to the output would leave the caller forwarding a value it only lent out
+bool inlinable(const FunctionGraph& g) {
+  const int output_node = int(g.insts.size());
+  const auto to_output = [&](const ValueForward& fwd) {
+    return stdr::any_of(fwd.terms, [&](Term t) { return t.node_id == output_node; });
+  };
+
+  return !g.insts.empty() && g.insts.size() <= MaxInlineSize && stdr::none_of(g.owned_fwds.front(), to_output) &&
+         stdr::none_of(g.input_borrowed_fwds, to_output);
+}
+
+bool is_value(const Program& p, Inst inst) {
+  const Program& owner = p.owner(inst);
+  return owner.inst[owner.index(inst)] == InstOp::Value;
+}
+
+bool is_pure(const Program& p, Inst inst) {
+  const Program& owner = p.owner(inst);
+  const i32 idx = owner.index(inst);
+  return owner.inst[idx] == InstOp::Fn && owner.fn_purities[owner.inst_data[idx]] == Purity::Pure;
+}
+
+// Merged nodes forward one set of outputs to the consumers of both, which only works if none take ownership
+bool shareable_outputs(const FunctionGraph& g, int node) {
+  return stdr::all_of(g.owned_fwds[node + 1], [](const ValueForward& f) { return f.copy_end == f.move_end; });
+}
+
 } // namespace
 
+std::tuple<FunctionGraph, Program> fold_pure_nodes(Program p, FunctionGraph g) {
+  if(stdr::none_of(g.insts, [&](Inst i) { return is_pure(p, i); })) {
+    return std::tuple(std::move(g), std::move(p));
+  }
+
+  const std::vector<NodeInputs> node_inputs = find_node_inputs(g);
+
+  std::vector<int> order = make_frame_layout(g).order;
+  if(g.tailcall) {
+    order.push_back(*g.tailcall);
+  }
+
+  auto [cg, graph_inputs] = make_graph(g.input_borrows);
+
+  // Oterms in the new graph of the outputs of every node of the old one, borrowed graph inputs are unchanged
+  std::vector<std::vector<std::optional<Oterm>>> outputs(g.insts.size() + 1);
+  for(const Oterm o : graph_inputs) {
+    if(!o.borrow) {
+      outputs[0].push_back(o);
+    }
+  }
+
+  // Value insts of the outputs known at compile time, only added to the new graph once something still uses them
+  std::vector<std::vector<std::optional<Inst>>> constants(g.insts.size() + 1);
+  constants[0].resize(outputs[0].size());
+
+  const auto constant_of = [&](Oterm old) {
+    return old.borrow ? std::nullopt : constants[old.term.node_id][old.term.port];
+  };
+
+  const auto new_oterm = [&](Oterm old) {
+    if(old.borrow) {
+      return old;
+    }
+
+    std::optional<Oterm>& o = outputs[old.term.node_id][old.term.port];
+    if(!o) {
+      o = cg.add(*constants[old.term.node_id][old.term.port], {}, {}, 1)[0];
+    }
+    return *o;
+  };
+
+  // Pure nodes already in the new graph by their inst and inputs
+  std::map<std::pair<Inst, std::vector<std::pair<Oterm, PassBy>>>, int> added;
+
+  for(const int i : order) {
+    const NodeInputs& inputs = node_inputs[i];
+    const Inst inst = g.insts[i];
+    const int output_count = int(g.owned_fwds[i + 1].size());
+
+    outputs[i + 1].resize(output_count);
+    constants[i + 1].resize(output_count);
+
+    if(is_value(p, inst)) {
+      constants[i + 1][0] = inst;
+      continue;
+    }
+
+    const bool pure = is_pure(p, inst);
+    const auto all_constant = [&](const auto& ports) {
+      return stdr::all_of(ports, [&](const auto& pair) { return constant_of(pair.first).has_value(); });
+    };
+
+    // Fns that throw are left to do so at runtime, move-only outputs aren't folded since value insts are copied out
+    // every time they run
+    if(pure && all_constant(inputs.owned) && all_constant(inputs.borrowed)) {
+      const auto values_of = [&](const auto& ports) {
+        return transform_to_vec(ports, [&](const auto& pair) { return *constant_of(pair.first); });
+      };
+      if(auto values = evaluate(p, inst, values_of(inputs.owned), values_of(inputs.borrowed)); values) {
+        for(int output = 0; output < std::ssize(*values); output++) {
+          const Inst value = p.add(std::move((*values)[output]));
+          p.folds.emplace(value, FoldedValue{inst, values_of(inputs.owned), values_of(inputs.borrowed), output});
+          constants[i + 1][output] = value;
+        }
+        continue;
+      }
+    }
+
+    std::vector<std::pair<Oterm, PassBy>> ports;
+    for(const auto& [oterm, pb] : inputs.owned) {
+      ports.emplace_back(new_oterm(oterm), pb);
+    }
+    for(const auto& [oterm, pb] : inputs.borrowed) {
+      ports.emplace_back(new_oterm(oterm), pb);
+    }
+
+    if(pure && shareable_outputs(g, i)) {
+      if(const auto [it, inserted] = added.emplace(std::pair(inst, ports), i); !inserted) {
+        outputs[i + 1] = outputs[it->second + 1];
+        continue;
+      }
+    }
+
+    const std::vector<Oterm> new_outputs =
+      cg.add(inst, transform_to_vec(ports, Get<0>{}), transform_to_vec(ports, Get<1>{}), output_count);
+    outputs[i + 1].assign(new_outputs.begin(), new_outputs.end());
+  }
+
+  const NodeInputs& graph_outputs = node_inputs.back();
+  return std::tuple(std::move(cg).finalize(transform_to_vec(graph_outputs.owned,
+                                                            [&](auto pair) { return new_oterm(pair.first); }),
+                                           transform_to_vec(graph_outputs.owned, Get<1>{})),
+                    std::move(p));
+}
+
+std::tuple<FunctionGraph, Program>
+inline_calls(Program p, FunctionGraph g, Span<std::optional<Inst>> known_inputs) {
+  assert(known_inputs.size() == g.input_borrows.size());
+
+  // Known fns are owned inputs, find them by their port
+  std::vector<std::optional<Inst>> known_ports;
+  for(int i = 0; i < std::ssize(g.input_borrows); i++) {
+    if(!g.input_borrows[i]) {
+      known_ports.push_back(known_inputs[i]);
+    }
+  }
+
+  const auto known_fn_of = [&](int node, const NodeInputs& inputs) -> std::optional<Inst> {
+    const Program& owner = p.owner(g.insts[node]);
+    if(owner.inst[owner.index(g.insts[node])] != InstOp::Functional) {
+      return std::nullopt;
+    }
+
+    const Oterm fn = inputs.owned.front().first;
+    return fn.term.node_id == 0 && !fn.borrow ? known_ports[fn.term.port] : std::nullopt;
+  };
+
+  const auto callee_of = [&](int node, const NodeInputs& inputs) -> std::optional<std::pair<Inst, std::vector<Any>>> {
+    const std::optional<Inst> fn = known_fn_of(node, inputs);
+    auto callee = fn ? find_callee_graph(p, *fn) : std::nullopt;
+    return callee && inlinable(graph_of(p, callee->first)) ? callee : std::nullopt;
+  };
+
+  // Natives are called directly so they're treated like any other node by later passes
+  const auto native_of = [&](int node, const NodeInputs& inputs) -> std::optional<Inst> {
+    const std::optional<Inst> fn = known_fn_of(node, inputs);
+    return fn && p.owner(*fn).inst[p.owner(*fn).index(*fn)] == InstOp::Fn ? fn : std::nullopt;
+  };
+
+  const std::vector<NodeInputs> node_inputs = find_node_inputs(g);
+
+  std::vector<int> order = make_frame_layout(g).order;
+  if(g.tailcall) {
+    order.push_back(*g.tailcall);
+  }
+
+  if(stdr::none_of(order, [&](int i) { return callee_of(i, node_inputs[i]) || native_of(i, node_inputs[i]); })) {
+    return std::tuple(std::move(g), std::move(p));
+  }
+
+  auto [cg, graph_inputs] = make_graph(g.input_borrows);
+
+  // Oterms in the new graph of the outputs of every node of the old one, borrowed graph inputs are unchanged
+  std::vector<std::vector<Oterm>> outputs(g.insts.size() + 1);
+  outputs[0] = filter_to_vec(graph_inputs, [](Oterm o) { return !o.borrow; });
+
+  const auto new_oterm = [&](Oterm old) { return old.borrow ? old : outputs[old.term.node_id][old.term.port]; };
+
+  for(const int i : order) {
+    const NodeInputs& inputs = node_inputs[i];
+
+    if(auto callee = callee_of(i, inputs); callee) {
+      const FunctionGraph callee_graph = graph_of(p, callee->first);
+
+      // Curried values are the last inputs of the callee, whether it borrows them or not
+      const int curried_begin = int(callee_graph.input_borrows.size() - callee->second.size());
+
+      int owned_idx = 1;
+      int borrowed_idx = 0;
+      std::vector<Oterm> args;
+      for(int j = 0; j < curried_begin; j++) {
+        args.push_back(new_oterm(
+          callee_graph.input_borrows[j] ? inputs.borrowed[borrowed_idx++].first : inputs.owned[owned_idx++].first));
+      }
+      for(Any& value : callee->second) {
+        args.push_back(cg.add(p.add(std::move(value)), {}, {}, 1)[0]);
+      }
+
+      outputs[i + 1] = cg.add(callee_graph, args);
+    } else {
+      const std::optional<Inst> native = native_of(i, inputs);
+
+      std::vector<Oterm> terms;
+      std::vector<PassBy> pass_bys;
+      for(const auto& [oterm, pb] : Span<std::pair<Oterm, PassBy>>(inputs.owned).subspan(native ? 1 : 0)) {
+        terms.push_back(new_oterm(oterm));
+        pass_bys.push_back(pb);
+      }
+      for(const auto& [oterm, pb] : inputs.borrowed) {
+        terms.push_back(new_oterm(oterm));
+        pass_bys.push_back(pb);
+      }
+
+      outputs[i + 1] = cg.add(native.value_or(g.insts[i]), terms, pass_bys, int(g.owned_fwds[i + 1].size()));
+    }
+  }
+
+  const NodeInputs& graph_outputs = node_inputs.back();
+  FunctionGraph inlined =
+    std::move(cg).finalize(transform_to_vec(graph_outputs.owned, [&](auto pair) { return new_oterm(pair.first); }),
+                           transform_to_vec(graph_outputs.owned, Get<1>{}));
+
+  // Inlined nodes may go unused or duplicate nodes of the caller
+  inlined = prune(std::move(inlined), std::vector<bool>(inlined.output_count, true), [&](Inst i) {
+    return has_side_effects(p, i);
+  });
+  return fold_pure_nodes(std::move(p), std::move(inlined));
+}
+
 ContextualResult<FunctionGraphData, Program>
 create_graph(Program p,
              const AST& ast,
@@ -494,6 +757,11 @@ create_graph(Program p,
       FunctionGraph g = std::move(ctx.cg).finalize(terms, pass_bys_of(copy_types, ast.tg, ast.types[expr.get()]));
 
       auto errors = find_borrow_move_dependency_errors(p, g, ast.srcs, ctx.oterm_srcs);
+      if(errors.empty()) {
+        const std::vector<bool> outputs(g.output_count, true);
+        g = prune(std::move(g), outputs, [&](Inst i) { return has_side_effects(p, i); });
+        std::tie(g, p) = fold_pure_nodes(std::move(p), std::move(g));
+      }
       return value_or_errors(FunctionGraphData{std::move(captured_values), std::move(captured_borrows), std::move(g)},
                              std::move(errors),
                              std::move(p));
@@ -17,4 +17,14 @@ struct FunctionGraphData {
 ContextualResult<FunctionGraphData, Program> create_graph(
   Program, const AST&, const std::unordered_set<TypeID>& copy_types, const Map<ASTID, ASTID>& overloads, ASTID);
 
+// Merges identical pure nodes and evaluates pure nodes whose inputs are all constants into values
+std::tuple<FunctionGraph, Program> fold_pure_nodes(Program, FunctionGraph);
+
+// Script fns with at most this many nodes are inlined into their callers
+constexpr int MaxInlineSize = 16;
+
+// Splices in the graphs of small script fns and calls natives directly when they're called through inputs known to hold
+// them, indexed like input_borrows
+std::tuple<FunctionGraph, Program> inline_calls(Program, FunctionGraph, Span<std::optional<Inst>> known_inputs);
+
 } // namespace ooze
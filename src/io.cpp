@@ -62,4 +62,15 @@ StringResult<std::string> read_text_file(const std::string& filename) {
   }
 }
 
+StringResult<void> write_text_file(const std::string& filename, std::string_view text) {
+  try {
+    return check_is_not_directory(filename).map([&]() {
+      std::ofstream file(filename);
+      file.write(text.data(), std::streamsize(text.size()));
+    });
+  } catch(const std::exception& ex) {
+    return err(ex.what());
+  }
+}
+
 } // namespace ooze
@@ -6,5 +6,6 @@ StringResult<void> write_binary_file(const std::string&, Span<std::byte>);
 StringResult<std::vector<std::byte>> read_binary_file(const std::string&);
 
 StringResult<std::string> read_text_file(const std::string& filename);
+StringResult<void> write_text_file(const std::string& filename, std::string_view);
 
 } // namespace ooze
@@ -2,52 +2,116 @@
 
 #include "lexer.h"
 
-#include <ctre.hpp>
+#include <cstring>
 
 namespace ooze {
 
 namespace {
 
-constexpr auto whitespace_re = ctll::fixed_string{"^\\s+"};
-constexpr auto comment_re = ctll::fixed_string{"^//[^\\n]*"};
-constexpr auto keyword_re = ctll::fixed_string{"^let|^fn|^if|^else|^mod"};
-constexpr auto underscore_re = ctll::fixed_string{"^_"};
-constexpr auto ident_re = ctll::fixed_string{"^[a-zA-Z_][a-zA-Z0-9_]*"};
-constexpr auto symbol_re = ctll::fixed_string{R"(^\(|^\)|^\{|^\}|^,|^\.|^::|^:|^&|^->|^=>|^=|^;)"};
-
-constexpr auto int_re = ctll::fixed_string{"^-?\\d+(i8|i16|i32|i64|u8|u16|u32|u64)?"};
-constexpr auto float_re = ctll::fixed_string{R"(^-?\d+?\.\d+f?)"};
-constexpr auto bool_re = ctll::fixed_string{"^true|^false"};
-constexpr auto string_re = ctll::fixed_string{"^\".*?\"|^'.*?'"};
-
-template <auto& T>
-using matcher = ctre::regex_search_t<typename ctre::regex_builder<T>::type>;
-
-constexpr std::tuple MATCHERS = {
-  std::tuple(TokenType::Whitespace, matcher<whitespace_re>{}),
-  std::tuple(TokenType::Comment, matcher<comment_re>{}),
-  std::tuple(TokenType::Keyword, matcher<keyword_re>{}),
-  std::tuple(TokenType::Underscore, matcher<underscore_re>{}),
-  std::tuple(TokenType::Symbol, matcher<symbol_re>{}),
-  std::tuple(TokenType::LiteralFloat, matcher<float_re>{}),
-  std::tuple(TokenType::LiteralInt, matcher<int_re>{}),
-  std::tuple(TokenType::LiteralBool, matcher<bool_re>{}),
-  std::tuple(TokenType::LiteralString, matcher<string_re>{}),
-  std::tuple(TokenType::Ident, matcher<ident_re>{})};
-
-template <typename... Ts>
-auto lex_one(const std::tuple<Ts...>& ts, std::string_view sv) {
-  const std::array<std::pair<TokenType, int>, sizeof...(Ts)> matches{
-    {{std::get<0>(std::get<Ts>(ts)), (int)std::get<1>(std::get<Ts>(ts))(sv).to_view().size()}...}};
-
-  return *std::max_element(matches.begin(), matches.end(), [](const auto& a, const auto& b) {
-    return a.second < b.second;
-  });
+constexpr std::array KEYWORDS = {"let", "fn", "if", "else", "mod"};
+constexpr std::array INT_SUFFIXES = {"i8", "i16", "i32", "i64", "u8", "u16", "u32", "u64"};
+
+constexpr std::pair<TokenType, int> NO_MATCH = {TokenType::Whitespace, 0};
+
+bool is_space(char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r'; }
+bool is_digit(char c) { return c >= '0' && c <= '9'; }
+bool is_ident_start(char c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_'; }
+bool is_ident(char c) { return is_ident_start(c) || is_digit(c); }
+
+template <typename F>
+int count_while(std::string_view sv, int i, F f) {
+  while(i < int(sv.size()) && f(sv[i])) {
+    i++;
+  }
+  return i;
+}
+
+// memchr is vectorized by libc which matters for long comments and strings
+int find_char(std::string_view sv, int i, char c) {
+  const void* found = std::memchr(sv.data() + i, c, sv.size() - i);
+  return found ? int(static_cast<const char*>(found) - sv.data()) : -1;
+}
+
+// Keywords and bools are also valid idents, they only take precedence when they span the whole word
+std::pair<TokenType, int> lex_word(std::string_view sv) {
+  const int size = count_while(sv, 1, is_ident);
+  const std::string_view word = sv.substr(0, size);
+
+  if(word == "_") {
+    return {TokenType::Underscore, size};
+  } else if(stdr::find(KEYWORDS, word) != KEYWORDS.end()) {
+    return {TokenType::Keyword, size};
+  } else if(word == "true" || word == "false") {
+    return {TokenType::LiteralBool, size};
+  } else {
+    return {TokenType::Ident, size};
+  }
+}
+
+std::pair<TokenType, int> lex_number(std::string_view sv) {
+  const int digits_begin = sv[0] == '-' ? 1 : 0;
+  const int digits_end = count_while(sv, digits_begin, is_digit);
+
+  if(digits_end == digits_begin) {
+    return NO_MATCH;
+  } else if(digits_end + 1 < int(sv.size()) && sv[digits_end] == '.' && is_digit(sv[digits_end + 1])) {
+    const int end = count_while(sv, digits_end + 1, is_digit);
+    return {TokenType::LiteralFloat, end < int(sv.size()) && sv[end] == 'f' ? end + 1 : end};
+  }
+
+  const std::string_view rest = sv.substr(digits_end);
+  const auto suffix = stdr::find_if(INT_SUFFIXES, [&](std::string_view suffix) { return rest.starts_with(suffix); });
+  return {TokenType::LiteralInt, digits_end + (suffix != INT_SUFFIXES.end() ? int(std::strlen(*suffix)) : 0)};
+}
+
+std::pair<TokenType, int> lex_symbol(std::string_view sv, char second) {
+  return {TokenType::Symbol, sv.size() > 1 && sv[1] == second ? 2 : 1};
 }
 
 } // namespace
 
-std::pair<TokenType, int> lex_one(std::string_view sv) { return lex_one(MATCHERS, sv); }
+std::pair<TokenType, int> lex_one(std::string_view sv) {
+  if(sv.empty()) {
+    return NO_MATCH;
+  }
+
+  const char c = sv[0];
+
+  if(is_space(c)) {
+    return {TokenType::Whitespace, count_while(sv, 1, is_space)};
+  } else if(is_ident_start(c)) {
+    return lex_word(sv);
+  } else if(is_digit(c)) {
+    return lex_number(sv);
+  }
+
+  switch(c) {
+  case '(':
+  case ')':
+  case '{':
+  case '}':
+  case ',':
+  case '.':
+  case ';':
+  case '&': return {TokenType::Symbol, 1};
+  case ':': return lex_symbol(sv, ':');
+  case '=': return lex_symbol(sv, '>');
+  case '-': return sv.size() > 1 && sv[1] == '>' ? std::pair(TokenType::Symbol, 2) : lex_number(sv);
+  case '/': {
+    if(sv.size() < 2 || sv[1] != '/') {
+      return NO_MATCH;
+    }
+    const int newline = find_char(sv, 2, '\n');
+    return {TokenType::Comment, newline >= 0 ? newline : int(sv.size())};
+  }
+  case '"':
+  case '\'': {
+    const int close = find_char(sv, 1, c);
+    return close >= 0 ? std::pair(TokenType::LiteralString, close + 1) : NO_MATCH;
+  }
+  default: return NO_MATCH;
+  }
+}
 
 std::pair<std::vector<Token>, int> lex(std::string_view sv) {
   std::vector<Token> tokens;
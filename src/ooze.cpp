@@ -1,38 +1,144 @@
 #include "pch.h"
 
 #include "bindings.h"
+#include "constructing_graph.h"
 #include "frontend.h"
 #include "function_graph_construction.h"
 #include "parser.h"
 #include "pretty_print.h"
 #include "runtime.h"
 #include "sema.h"
+#include "serialization.h"
 #include "user_msg.h"
 
 #include "ooze/core.h"
 
+#include <map>
+
 namespace ooze {
 
+// Assignment a binding was produced by, along with the bindings it read
+struct Derivation {
+  std::string statement;
+  std::vector<std::string> inputs;
+  std::vector<std::string> outputs;
+};
+
 struct EnvData {
   std::string src;
   AST ast;
   NativeTypeInfo native_types;
-  Program program;
+
+  // Shared with everything executing it, runs only allocate a layer on top for the insts they add
+  std::shared_ptr<const Program> program;
 
   Map<ASTID, Inst> fns;
   Map<std::string, Binding> bindings;
 
+  // Assignments by the order they ran in, in reactive mode they're rerun when a binding they read is rebound
+  std::map<i64, Derivation> derivations;
+  Map<std::string, i64> derived_bindings;
+  i64 next_derivation = 0;
+  bool reactive = false;
+
   TypeCache type_cache;
   ASTID native_module;
+  ASTID scripts_module;
   std::vector<ASTID> parsed_roots;
 
   SrcRef bindings_ref;
   SrcRef scripts_ref;
   SrcRef to_string_ref;
+
+  // Used to persist parsed scripts, only valid for envs created from the same registry
+  TypeTable type_table;
+  u64 native_signature = 0;
+};
+
+struct CompiledFn {
+  std::string name;
+  std::string type;
+  Inst inst;
+
+  // Leaf types of the inputs in the order they're passed, fn values have none
+  std::vector<TypeID> owned_inputs;
+  std::vector<TypeID> borrowed_inputs;
+  int outputs = 0;
+};
+
+struct CompiledEnvData {
+  std::shared_ptr<const Program> program;
+  TypeNames type_names;
+
+  // Sorted by name so overloads are adjacent
+  std::vector<CompiledFn> fns;
 };
 
 namespace {
 
+constexpr int MaxProgramDepth = 8;
+
+// Fn generated while running an expression, added to the env once the run is finished with the AST
+struct GeneratedFn {
+  std::string name;
+  Type type;
+  Inst inst;
+};
+
+// End of the env's AST before a run appends to it
+struct ASTCheckpoint {
+  ASTID forest_size;
+  Type type_count;
+};
+
+ASTCheckpoint checkpoint(const AST& ast) { return {ASTID(i32(ast.forest.size())), Type(ast.tg.num_nodes())}; }
+
+// Drops everything appended since the checkpoint, types that outlive the run are added back afterwards
+std::vector<Type> rollback(AST& ast, ASTCheckpoint cp, Span<Type> keep) {
+  const auto appended = [&](Type t) { return t.is_valid() && t >= cp.type_count; };
+
+  // Post order so fanouts are added back before the types referring to them
+  Set<Type> visited;
+  std::vector<std::tuple<Type, std::vector<Type>, TypeTag, TypeID>> nodes;
+  const auto record = [&](auto self, Type t) -> void {
+    if(appended(t) && visited.insert(t).second) {
+      for(const Type f : ast.tg.fanout(t)) {
+        self(self, f);
+      }
+      nodes.emplace_back(t, to_vec(ast.tg.fanout(t)), ast.tg.get<TypeTag>(t), ast.tg.get<TypeID>(t));
+    }
+  };
+
+  for(const Type t : keep) {
+    record(record, t);
+  }
+
+  ast.forest.truncate(cp.forest_size);
+  ast.srcs.resize(ast.forest.size());
+  ast.types.resize(ast.forest.size());
+  std::erase_if(ast.literals, [&](const auto& p) { return p.first >= cp.forest_size; });
+
+  while(ast.tg.num_nodes() > cp.type_count.get()) {
+    ast.tg.pop_node();
+  }
+
+  Map<Type, Type> moved;
+  const auto lookup = [&](Type t) { return appended(t) ? moved.at(t) : t; };
+  for(auto& [old_type, fanout, tag, id] : nodes) {
+    for(Type& f : fanout) {
+      f = lookup(f);
+    }
+    moved.emplace(old_type, ast.tg.add_node(fanout, tag, id));
+  }
+
+  return transform_to_vec(keep, lookup);
+}
+
+// Layers are flattened once resolving an inst through them would start to cost more than the occasional copy
+std::shared_ptr<const Program> publish(Program p) {
+  return std::make_shared<const Program>(p.depth() > MaxProgramDepth ? flatten(p) : std::move(p));
+}
+
 template <typename T>
 auto add_global(AST ast, Map<ASTID, T> ident_map, std::vector<ASTID> roots, T t, SrcRef ref, Type type, Type unit) {
   const ASTID ident = append_root(ast, ASTTag::PatternIdent, ref, type);
@@ -48,6 +154,30 @@ void add_fn(EnvData& env, std::string_view name, Type type, Inst fn) {
   const SrcRef ref = {SrcID{0}, append_src(env.src, name)};
   std::tie(env.ast, env.fns, env.parsed_roots) =
     add_global(std::move(env.ast), std::move(env.fns), std::move(env.parsed_roots), fn, ref, type, env.type_cache.unit);
+  env.ast.forest.move_last_child(env.scripts_module, env.parsed_roots.back());
+}
+
+// A binding rebound on its own no longer comes from its assignment, nor do the others that assignment produced
+void forget_derivation(EnvData& env, const std::string& binding) {
+  if(const auto it = env.derived_bindings.find(binding); it != env.derived_bindings.end()) {
+    const auto derivation = env.derivations.find(it->second);
+    for(const std::string& output : derivation->second.outputs) {
+      env.derived_bindings.erase(output);
+    }
+    env.derivations.erase(derivation);
+  }
+}
+
+void record_derivation(EnvData& env, Derivation derivation) {
+  for(const std::string& output : derivation.outputs) {
+    forget_derivation(env, output);
+  }
+
+  const i64 order = env.next_derivation++;
+  for(const std::string& output : derivation.outputs) {
+    env.derived_bindings.emplace(output, order);
+  }
+  env.derivations.emplace(order, std::move(derivation));
 }
 
 bool is_binding_copyable(const TypeGraph& tg, const std::unordered_set<TypeID>& copy_types, Type type) {
@@ -84,10 +214,25 @@ std::tuple<std::vector<AsyncValue>, Map<ASTID, std::vector<AsyncValue>>> run_fun
   const AST& ast,
   const std::unordered_set<TypeID>& copy_types,
   const Map<ASTID, Inst>& functions,
+  const Map<ASTID, Inst>& generated_functions,
   Executor& ex,
   Program program,
   FunctionGraphData fg_data,
   Map<ASTID, std::vector<AsyncValue>> bindings) {
+  // Captured fns are the only inputs known before running
+  std::vector<std::optional<Inst>> known_inputs;
+  for(const ASTID id : fg_data.captured_values) {
+    if(bindings.find(id) == bindings.end()) {
+      const auto fn_it = functions.find(id);
+      known_inputs.push_back(fn_it != functions.end() ? fn_it->second : generated_functions.at(id));
+    } else {
+      known_inputs.resize(known_inputs.size() + size_of(ast.tg, ast.types[id.get()]));
+    }
+  }
+  known_inputs.resize(fg_data.graph.input_borrows.size());
+
+  std::tie(fg_data.graph, program) = inline_calls(std::move(program), std::move(fg_data.graph), known_inputs);
+
   const int output_count = fg_data.graph.output_count;
   const Inst graph_inst = program.add(std::move(fg_data.graph));
 
@@ -101,8 +246,7 @@ std::tuple<std::vector<AsyncValue>, Map<ASTID, std::vector<AsyncValue>>> run_fun
   auto futures = fold(fg_data.captured_values, std::vector<Future>{}, [&](auto acc, ASTID id) {
     if(const auto it = bindings.find(id); it == bindings.end()) {
       const auto fn_it = functions.find(id);
-      assert(fn_it != functions.end());
-      acc.emplace_back(Any(fn_it->second));
+      acc.emplace_back(Any(fn_it != functions.end() ? fn_it->second : generated_functions.at(id)));
     } else if(is_binding_copyable(ast.tg, copy_types, ast.types[id.get()])) {
       acc = transform_to_vec(
         it->second, [](AsyncValue& v) { return borrow(v).then([](const Any& a) { return a; }); }, std::move(acc));
@@ -138,7 +282,8 @@ auto assign_values(
 }
 
 ContextualResult<std::vector<std::tuple<ASTID, ASTID, Inst>>, Program>
-generate_fns(Program program,
+generate_fns(Span<std::string_view> srcs,
+             Program program,
              const AST& ast,
              const Map<ASTID, Inst>& existing_fns,
              const std::unordered_set<TypeID>& copy_types,
@@ -148,7 +293,9 @@ generate_fns(Program program,
     assert(ast.forest[root] == ASTTag::Assignment);
     const auto [pattern, expr] = ast.forest.child_ids(root).take<2>();
     assert(ast.forest[expr] == ASTTag::Fn);
-    return std::tuple(pattern, expr, program.placeholder());
+    const Inst inst = program.placeholder();
+    program.names.emplace(inst, std::string(sv(srcs, ast.srcs[pattern.get()])));
+    return std::tuple(pattern, expr, inst);
   });
 
   std::vector<ContextualError> errors;
@@ -163,17 +310,35 @@ generate_fns(Program program,
             if(fg.captured_values.empty()) {
               p.set(inst, std::move(fg.graph));
             } else {
-              std::vector<Any> values = transform_to_vec(fg.captured_values, [&](ASTID id) {
+              const std::vector<Inst> captured_fns = transform_to_vec(fg.captured_values, [&](ASTID id) {
                 if(const auto it = existing_fns.find(id); it != existing_fns.end()) {
-                  return Any(it->second);
+                  return it->second;
                 } else {
                   const auto it2 = stdr::find_if(fns, flattened([&](ASTID pat, ASTID, Inst) { return pat == id; }));
                   assert(it2 != fns.end());
-                  return Any(std::get<2>(*it2));
+                  return std::get<2>(*it2);
                 }
               });
 
-              p.set(inst, p.add(std::move(fg.graph)), std::move(values));
+              // Captured fns follow the params and are followed by captured borrows
+              const int borrowed_size = fold(fg.captured_borrows, 0, [&](int acc, ASTID id) {
+                return acc + size_of(ast.tg, ast.types[id.get()]);
+              });
+              std::vector<std::optional<Inst>> known_inputs(
+                fg.graph.input_borrows.size() - captured_fns.size() - borrowed_size);
+              known_inputs.insert(known_inputs.end(), captured_fns.begin(), captured_fns.end());
+              known_inputs.resize(fg.graph.input_borrows.size());
+
+              std::tie(fg.graph, p) = inline_calls(std::move(p), std::move(fg.graph), known_inputs);
+
+              // Captured fns that are never moved are borrowed from the curry instead of copied into every call
+              if(borrowed_size == 0) {
+                std::vector<bool> candidates(fg.graph.input_borrows.size() - captured_fns.size(), false);
+                candidates.resize(fg.graph.input_borrows.size(), true);
+                fg.graph = borrow_unmoved_inputs(std::move(fg.graph), candidates);
+              }
+
+              p.set(inst, p.add(std::move(fg.graph)), transform_to_vec(captured_fns, Construct<Any>{}));
             }
 
             return ContextualResult<void, Program>{Failure{std::vector<ContextualError>{}}, std::move(p)};
@@ -197,16 +362,14 @@ EnvData copy_generic_fns(Span<std::string_view> srcs, EnvData env, const AST& as
     const Slice new_slice = append_src(env.src, sv(srcs, ast.srcs[root.get()]));
     const i32 new_offset = new_slice.begin;
 
-    const auto module = owning_module(ast.forest, root);
-    assert(module);
-
-    const ASTID copy = copy_tree_under(ast.forest, root, env.ast.forest, *module, [&](ASTID old_id, ASTID new_id) {
-      // TODO literals
-      env.ast.types[new_id.get()] = copy_type(env, ast.tg, ast.types[old_id.get()]);
-      const Slice old_slice = ast.srcs[old_id.get()].slice;
-      const i32 offset = new_offset + old_slice.begin - original_offset;
-      env.ast.srcs[new_id.get()] = SrcRef{SrcID(0), {offset, offset + size(old_slice)}};
-    });
+    const ASTID copy =
+      copy_tree_under(ast.forest, root, env.ast.forest, env.scripts_module, [&](ASTID old_id, ASTID new_id) {
+        // TODO literals
+        env.ast.types[new_id.get()] = copy_type(env, ast.tg, ast.types[old_id.get()]);
+        const Slice old_slice = ast.srcs[old_id.get()].slice;
+        const i32 offset = new_offset + old_slice.begin - original_offset;
+        env.ast.srcs[new_id.get()] = SrcRef{SrcID(0), {offset, offset + size(old_slice)}};
+      });
 
     env.parsed_roots.push_back(copy);
   }
@@ -214,40 +377,79 @@ EnvData copy_generic_fns(Span<std::string_view> srcs, EnvData env, const AST& as
   return env;
 }
 
-auto prepare_ast(const EnvData& env, Map<std::string, Binding> str_bindings) {
-  std::string src = env.src;
-  AST ast = env.ast;
+// Bindings are added to the env's AST as globals named by a separate src
+auto prepare_ast(const EnvData& env, AST ast, Map<std::string, Binding> str_bindings) {
+  std::string src;
   Map<ASTID, std::vector<AsyncValue>> bindings;
   std::vector<ASTID> roots;
   roots.reserve(str_bindings.size());
 
   const Type unit = env.type_cache.unit;
-  const ASTID env_module = append_root(ast, ASTTag::Module, env.scripts_ref, unit, env.parsed_roots);
 
   for(auto& [name, binding] : str_bindings) {
-    std::tie(ast, bindings, roots) = add_global(
-      std::move(ast),
-      std::move(bindings),
-      std::move(roots),
-      std::move(binding.values),
-      SrcRef{SrcID{0}, append_src(src, name)},
-      binding.type,
-      unit);
+    std::tie(ast, bindings, roots) = add_global(std::move(ast),
+                                                std::move(bindings),
+                                                std::move(roots),
+                                                std::move(binding.values),
+                                                SrcRef{SrcID{2}, append_src(src, name)},
+                                                binding.type,
+                                                unit);
   }
 
   const ASTID binding_module = append_root(ast, ASTTag::Module, env.bindings_ref, unit, roots);
 
-  return std::tuple(
-    std::move(src), std::move(ast), std::move(bindings), std::array{env.native_module, env_module, binding_module});
+  return std::tuple(std::move(src),
+                    std::move(ast),
+                    std::move(bindings),
+                    std::array{env.native_module, env.scripts_module, binding_module});
 }
 
-EnvData to_str_bindings(
-  Span<std::string_view> srcs, const AST& ast, EnvData env, Map<ASTID, std::vector<AsyncValue>> bindings) {
-  for(auto& [id, values] : bindings) {
-    env.bindings.emplace(std::string(sv(srcs, ast.srcs[id.get()])),
-                         Binding{copy_type(env, ast.tg, ast.types[id.get()]), std::move(values)});
+// Hands the AST back to the env without anything the run appended to it besides the resulting globals and bindings
+StringResult<Binding, EnvData>
+finish_run(Span<std::string_view> srcs,
+           std::string&& env_src,
+           ASTCheckpoint cp,
+           std::vector<GeneratedFn> fns,
+           ContextualResult<Binding, AST, EnvData, Map<ASTID, std::vector<AsyncValue>>> result) {
+  auto [ast, env, bindings] = std::move(result.state());
+
+  std::vector<Type> keep = transform_to_vec(fns, [](const GeneratedFn& fn) { return fn.type; });
+  // By id so a binding assigned by the run replaces the one it rebinds, which was added to the AST before it
+  std::vector<std::pair<std::string, std::vector<AsyncValue>>> named_bindings;
+  for(const ASTID id : sorted(transform_to_vec(bindings, Get<0>{}))) {
+    keep.push_back(ast.types[id.get()]);
+    named_bindings.emplace_back(std::string(sv(srcs, ast.srcs[id.get()])), std::move(bindings.at(id)));
+  }
+
+  std::optional<Binding> binding;
+  std::vector<std::string> errors;
+  if(result) {
+    binding = std::move(result.value());
+    keep.push_back(binding->type);
+  } else {
+    errors = contextualize(srcs, std::move(result.error()));
+  }
+
+  const std::vector<Type> kept = rollback(ast, cp, keep);
+
+  env.src = std::move(env_src);
+  env.ast = std::move(ast);
+
+  for(size_t i = 0; i < fns.size(); i++) {
+    add_fn(env, fns[i].name, kept[i], fns[i].inst);
+  }
+
+  for(size_t i = 0; i < named_bindings.size(); i++) {
+    env.bindings.insert_or_assign(std::move(named_bindings[i].first),
+                                  Binding{kept[fns.size() + i], std::move(named_bindings[i].second)});
+  }
+
+  if(binding) {
+    binding->type = kept.back();
+    return {std::move(*binding), std::move(env)};
+  } else {
+    return {Failure{std::move(errors)}, std::move(env)};
   }
-  return env;
 }
 
 ContextualResult<Binding, EnvData, Map<ASTID, std::vector<AsyncValue>>> run_or_assign(
@@ -257,27 +459,34 @@ ContextualResult<Binding, EnvData, Map<ASTID, std::vector<AsyncValue>>> run_or_a
   const SemaData& s,
   EnvData env,
   Map<ASTID, std::vector<AsyncValue>> bindings,
-  ASTID id) {
+  ASTID id,
+  std::vector<GeneratedFn>& new_fns) {
   assert(owning_module(ast.forest, id));
   assert(s.generic_roots.empty());
 
-  return generate_fns(std::move(env.program),
+  return generate_fns(srcs,
+                      Program(env.program),
                       ast,
                       env.fns,
                       env.native_types.copyable,
                       s.overloads,
                       filter_to_vec(s.resolved_roots, [&](ASTID id) { return !ast.forest.is_root(id); }))
     .and_then([&](auto generated_fns, Program p) {
-      env.program = p;
-      auto fns = env.fns;
+      Map<ASTID, Inst> fns;
 
       for(const auto [pattern, expr, inst] : generated_fns) {
         assert(pattern.is_valid());
         fns.emplace(pattern, inst);
-        add_fn(env, sv(srcs, ast.srcs[pattern.get()]), copy_type(env, ast.tg, ast.types[pattern.get()]), inst);
+        new_fns.push_back({std::string(sv(srcs, ast.srcs[pattern.get()])), ast.types[pattern.get()], inst});
+      }
+
+      // New fns stay in the env while the expression's graph goes in a layer only this run refers to
+      if(!generated_fns.empty()) {
+        env.program = publish(std::move(p));
+        p = Program(env.program);
       }
 
-      return create_graph(env.program,
+      return create_graph(std::move(p),
                           ast,
                           env.native_types.copyable,
                           s.overloads,
@@ -289,17 +498,37 @@ ContextualResult<Binding, EnvData, Map<ASTID, std::vector<AsyncValue>>> run_or_a
     .map_state(nullify())
     .append_state(std::move(env), std::move(bindings))
     .map(flattened([&](FunctionGraphData fg_data, auto fns, Program p, EnvData env, auto bindings) {
+      // Named before running since it takes the bindings it moves
+      std::vector<std::string> inputs;
+      for(const ASTID captured : flatten(fg_data.captured_values, fg_data.captured_borrows)) {
+        if(bindings.contains(captured)) {
+          inputs.emplace_back(sv(srcs, ast.srcs[captured.get()]));
+        }
+      }
+
       std::vector<AsyncValue> values;
-      std::tie(values, bindings) =
-        run_function(ast, env.native_types.copyable, fns, ex, std::move(p), std::move(fg_data), std::move(bindings));
+      std::tie(values, bindings) = run_function(
+        ast, env.native_types.copyable, env.fns, fns, ex, std::move(p), std::move(fg_data), std::move(bindings));
+
+      const Type type = ast.types[id.get()];
+
+      if(is_expr(ast.forest[id])) {
+        return std::tuple(Binding{type, std::move(values)}, std::move(env), std::move(bindings));
+      }
+
+      const ASTID pattern = *ast.forest.first_child(id);
 
-      const Type type = copy_type(env, ast.tg, ast.types[id.get()]);
+      std::vector<std::string> outputs;
+      for(const ASTID leaf : ast.forest.leaf_ids(pattern)) {
+        if(ast.forest[leaf] == ASTTag::PatternIdent) {
+          outputs.emplace_back(sv(srcs, ast.srcs[leaf.get()]));
+        }
+      }
+      record_derivation(
+        env, Derivation{std::string(srcs[ast.srcs[id.get()].file.get()]), std::move(inputs), std::move(outputs)});
 
-      return is_expr(ast.forest[id])
-               ? std::tuple(Binding{type, std::move(values)}, std::move(env), std::move(bindings))
-               : std::tuple(Binding{type},
-                            std::move(env),
-                            assign_values(ast, std::move(bindings), std::move(values), *ast.forest.first_child(id)));
+      return std::tuple(
+        Binding{type}, std::move(env), assign_values(ast, std::move(bindings), std::move(values), pattern));
     }));
 }
 
@@ -322,14 +551,19 @@ StringResult<void, EnvData> parse_scripts(EnvData env, Span<std::string_view> fi
       return type_name_resolution(srcs, env.native_types.names, std::move(pr), std::move(ast));
     })
     .and_then([&](std::vector<ASTID> roots, AST ast) {
-      return sema(srcs, env.type_cache, env.native_types, std::move(ast), roots, std::array{env.native_module});
+      return sema(srcs,
+                  env.type_cache,
+                  env.native_types,
+                  std::move(ast),
+                  roots,
+                  std::array{env.native_module, env.scripts_module});
     })
     .append_state(std::move(env))
     .and_then([&](SemaData s, AST ast, EnvData env) {
       return generate_fns(
-               std::move(env.program), ast, env.fns, env.native_types.copyable, s.overloads, s.resolved_roots)
+               srcs, Program(env.program), ast, env.fns, env.native_types.copyable, s.overloads, s.resolved_roots)
         .map_state([&](Program p) {
-          env.program = std::move(p);
+          env.program = publish(std::move(p));
           return std::tuple(std::move(ast), std::move(env));
         })
         .map([&](auto generated_fns, AST ast, EnvData env) {
@@ -349,83 +583,135 @@ StringResult<void, EnvData> parse_scripts(EnvData env, Span<std::string_view> fi
 }
 
 StringResult<Binding, EnvData> run(Executor& ex, EnvData env, std::string_view expr) {
-  auto [env_src, ast, bindings, global_imports_] = prepare_ast(env, std::move(env.bindings));
+  std::string env_src = std::move(env.src);
+  const ASTCheckpoint cp = checkpoint(env.ast);
+  auto [bindings_src, ast, bindings, global_imports_] = prepare_ast(env, std::move(env.ast), std::move(env.bindings));
   const auto global_imports = global_imports_;
-  const auto srcs = make_sv_array(env_src, expr);
+  const auto srcs = make_sv_array(env_src, expr, bindings_src);
+  std::vector<GeneratedFn> new_fns;
 
-  return parse_and_name_resolution(parse_repl, srcs, env.native_types.names, std::move(ast), SrcID{1})
-    .and_then([&](const ASTID root, AST ast) {
-      return sema(srcs, env.type_cache, env.native_types, std::move(ast), std::array{root}, global_imports)
-        .map([&](SemaData s, AST ast) { return std::tuple(std::tuple(std::move(s), root), std::move(ast)); });
-    })
-    .append_state(std::move(env), std::move(bindings))
-    .and_then(
-      flattened([&](SemaData s, ASTID expr, AST ast, EnvData env, Map<ASTID, std::vector<AsyncValue>> bindings) {
-        return run_or_assign(srcs, ex, ast, s, std::move(env), std::move(bindings), expr)
-          .map_state([&](EnvData env, auto bindings) {
-            return std::tuple(std::move(ast), std::move(env), std::move(bindings));
-          });
-      }))
-    .map_state([&](AST ast, EnvData env, Map<ASTID, std::vector<AsyncValue>> bindings) {
-      return to_str_bindings(srcs, ast, std::move(env), std::move(bindings));
-    })
-    .map_error([&](auto errors, EnvData env) {
-      return std::tuple(contextualize(srcs, std::move(errors)), std::move(env));
-    });
+  auto result =
+    parse_and_name_resolution(parse_repl, srcs, env.native_types.names, std::move(ast), SrcID{1})
+      .and_then([&](const ASTID root, AST ast) {
+        return sema(srcs, env.type_cache, env.native_types, std::move(ast), std::array{root}, global_imports)
+          .map([&](SemaData s, AST ast) { return std::tuple(std::tuple(std::move(s), root), std::move(ast)); });
+      })
+      .append_state(std::move(env), std::move(bindings))
+      .and_then(
+        flattened([&](SemaData s, ASTID expr, AST ast, EnvData env, Map<ASTID, std::vector<AsyncValue>> bindings) {
+          return run_or_assign(srcs, ex, ast, s, std::move(env), std::move(bindings), expr, new_fns)
+            .map_state([&](EnvData env, auto bindings) {
+              return std::tuple(std::move(ast), std::move(env), std::move(bindings));
+            });
+        }));
+
+  return finish_run(srcs, std::move(env_src), cp, std::move(new_fns), std::move(result));
 }
 
 StringResult<Future, EnvData> run_to_string(Executor& ex, EnvData env, std::string_view expr) {
-  auto [env_src, ast, bindings, global_imports_] = prepare_ast(env, std::move(env.bindings));
+  std::string env_src = std::move(env.src);
+  const ASTCheckpoint cp = checkpoint(env.ast);
+  auto [bindings_src, ast, bindings, global_imports_] = prepare_ast(env, std::move(env.ast), std::move(env.bindings));
   const auto global_imports = global_imports_;
-  const auto srcs = make_sv_array(env_src, expr);
-
-  return parse_and_name_resolution(parse_repl, srcs, env.native_types.names, std::move(ast), SrcID{1})
-    .and_then([&](const ASTID root, AST ast) {
-      if(ast.forest[root] == ASTTag::Assignment) {
-        return sema(srcs, env.type_cache, env.native_types, std::move(ast), std::array{root}, global_imports)
-          .map([&](SemaData s, AST ast) { return std::tuple(std::tuple(std::move(s), root), std::move(ast)); });
-      } else {
-        return sema(srcs, env.type_cache, env.native_types, std::move(ast), std::array{root}, global_imports)
-          .and_then([&](auto, AST ast) {
-            const Type expr_type = ast.types[root.get()];
-            const Type borrow_type = ast.tg.add_node(std::array{expr_type}, TypeTag::Borrow, TypeID{});
-            const Type tuple_type = ast.tg.add_node(std::array{borrow_type}, TypeTag::Tuple, TypeID{});
-            const Type string_type = ast.tg.add_node(TypeTag::Leaf, type_id(knot::Type<std::string>{}));
-            const Type fn_type = ast.tg.add_node(std::array{tuple_type, string_type}, TypeTag::Fn, TypeID{});
-
-            const ASTID borrow_id = append_root(ast, ASTTag::ExprBorrow, SrcRef{}, borrow_type, std::array{root});
-            const ASTID tuple_id = append_root(ast, ASTTag::ExprTuple, SrcRef{}, tuple_type, std::array{borrow_id});
-            const ASTID callee_id = append_root(ast, ASTTag::ExprIdent, env.to_string_ref, fn_type);
-            const ASTID call_id =
-              append_root(ast, ASTTag::ExprCall, SrcRef{}, string_type, std::array{callee_id, tuple_id});
-
-            return sema(srcs, env.type_cache, env.native_types, std::move(ast), std::array{call_id}, global_imports)
-              .map([&](SemaData s, AST ast) { return std::tuple(std::tuple(std::move(s), call_id), std::move(ast)); });
-          });
-      }
-    })
-    .append_state(std::move(env), std::move(bindings))
-    .and_then(
-      flattened([&](SemaData s, ASTID expr, AST ast, EnvData env, Map<ASTID, std::vector<AsyncValue>> bindings) {
-        return run_or_assign(srcs, ex, ast, s, std::move(env), std::move(bindings), expr)
-          .map_state([&](EnvData env, auto bindings) {
-            return std::tuple(std::move(ast), std::move(env), std::move(bindings));
-          });
-      }))
-    .map_state([&](AST ast, EnvData env, Map<ASTID, std::vector<AsyncValue>> bindings) {
-      return to_str_bindings(srcs, ast, std::move(env), std::move(bindings));
-    })
+  const auto srcs = make_sv_array(env_src, expr, bindings_src);
+  std::vector<GeneratedFn> new_fns;
+
+  auto result =
+    parse_and_name_resolution(parse_repl, srcs, env.native_types.names, std::move(ast), SrcID{1})
+      .and_then([&](const ASTID root, AST ast) {
+        if(ast.forest[root] == ASTTag::Assignment) {
+          return sema(srcs, env.type_cache, env.native_types, std::move(ast), std::array{root}, global_imports)
+            .map([&](SemaData s, AST ast) { return std::tuple(std::tuple(std::move(s), root), std::move(ast)); });
+        } else {
+          return sema(srcs, env.type_cache, env.native_types, std::move(ast), std::array{root}, global_imports)
+            .and_then([&](auto, AST ast) {
+              const Type expr_type = ast.types[root.get()];
+              const Type borrow_type = ast.tg.add_node(std::array{expr_type}, TypeTag::Borrow, TypeID{});
+              const Type tuple_type = ast.tg.add_node(std::array{borrow_type}, TypeTag::Tuple, TypeID{});
+              const Type string_type = ast.tg.add_node(TypeTag::Leaf, type_id(knot::Type<std::string>{}));
+              const Type fn_type = ast.tg.add_node(std::array{tuple_type, string_type}, TypeTag::Fn, TypeID{});
+
+              const ASTID borrow_id = append_root(ast, ASTTag::ExprBorrow, SrcRef{}, borrow_type, std::array{root});
+              const ASTID tuple_id = append_root(ast, ASTTag::ExprTuple, SrcRef{}, tuple_type, std::array{borrow_id});
+              const ASTID callee_id = append_root(ast, ASTTag::ExprIdent, env.to_string_ref, fn_type);
+              const ASTID call_id =
+                append_root(ast, ASTTag::ExprCall, SrcRef{}, string_type, std::array{callee_id, tuple_id});
+
+              return sema(srcs, env.type_cache, env.native_types, std::move(ast), std::array{call_id}, global_imports)
+                .map([&](SemaData s, AST ast) {
+                  return std::tuple(std::tuple(std::move(s), call_id), std::move(ast));
+                });
+            });
+        }
+      })
+      .append_state(std::move(env), std::move(bindings))
+      .and_then(
+        flattened([&](SemaData s, ASTID expr, AST ast, EnvData env, Map<ASTID, std::vector<AsyncValue>> bindings) {
+          return run_or_assign(srcs, ex, ast, s, std::move(env), std::move(bindings), expr, new_fns)
+            .map_state([&](EnvData env, auto bindings) {
+              return std::tuple(std::move(ast), std::move(env), std::move(bindings));
+            });
+        }));
+
+  return finish_run(srcs, std::move(env_src), cp, std::move(new_fns), std::move(result))
     .map([](Binding b, EnvData env) {
       assert(b.values.size() <= 1);
       assert(b.values.empty() || env.ast.tg.get<TypeID>(b.type) == type_id(knot::Type<std::string>{}));
       return std::tuple(b.values.size() == 1 ? take(std::move(b.values[0])) : Future(Any(std::string())),
                         std::move(env));
-    })
-    .map_error([&](auto errors, EnvData env) {
-      return std::tuple(contextualize(srcs, std::move(errors)), std::move(env));
     });
 }
 
+// Reruns the assignments that ran before until and read a rebound binding, or one rebound by an earlier rerun, in the
+// order they first ran. Runs don't wait on each other so independent assignments execute in parallel.
+StringResult<void, EnvData> recompute(Executor& ex, EnvData env, std::vector<std::string> rebound, i64 until) {
+  std::unordered_set<std::string> dirty(rebound.begin(), rebound.end());
+
+  // Rerunning an assignment records it again as the latest, so which ones to visit is decided up front
+  std::vector<i64> orders;
+  for(auto it = env.derivations.begin(); it != env.derivations.lower_bound(until); ++it) {
+    orders.push_back(it->first);
+  }
+
+  for(const i64 order : orders) {
+    const auto it = env.derivations.find(order);
+    if(it == env.derivations.end() ||
+       stdr::none_of(it->second.inputs, [&](const std::string& input) { return dirty.contains(input); })) {
+      continue;
+    }
+
+    const Derivation derivation = it->second;
+    auto result = run(ex, std::move(env), derivation.statement);
+    if(!result) {
+      return {Failure{std::move(result.error())}, std::get<0>(std::move(result).state())};
+    }
+
+    env = std::get<0>(std::move(result).state());
+    dirty.insert(derivation.outputs.begin(), derivation.outputs.end());
+  }
+
+  return std::move(env);
+}
+
+// Recomputes whatever was derived from the bindings assigned by a run that started with since as the next derivation
+template <typename T>
+StringResult<T, EnvData> react(Executor& ex, i64 since, StringResult<T, EnvData> result) {
+  if(!result || !std::get<0>(result.state()).reactive) {
+    return result;
+  }
+
+  return std::move(result).and_then([&](T value, EnvData env) {
+    std::vector<std::string> rebound;
+    for(auto it = env.derivations.lower_bound(since); it != env.derivations.end(); ++it) {
+      rebound.insert(rebound.end(), it->second.outputs.begin(), it->second.outputs.end());
+    }
+
+    return recompute(ex, std::move(env), std::move(rebound), since).map([&](EnvData env) {
+      return std::tuple(std::move(value), std::move(env));
+    });
+  });
+}
+
 EnvData create_env_data(NativeRegistry r) {
   // TODO check invariants on type and fn names
 
@@ -442,8 +728,11 @@ EnvData create_env_data(NativeRegistry r) {
   std::vector<ASTID> roots;
   roots.reserve(r.fns.size());
 
+  Program program;
   for(NativeFn& fn : r.fns) {
-    const Inst fn_inst = d.program.add(std::move(fn.fn), size_of(d.ast.tg, d.ast.tg.fanout(fn.type)[1]));
+    const Inst fn_inst = program.add(
+      std::move(fn.fn), size_of(d.ast.tg, d.ast.tg.fanout(fn.type)[1]), fn.cost, fn.purity, fn.async);
+    program.names.emplace(fn_inst, fn.name);
     const SrcRef ref = {SrcID{0}, append_src(d.src, fn.name)};
     std::tie(d.ast, d.fns, roots) =
       add_global(std::move(d.ast), std::move(d.fns), std::move(roots), fn_inst, ref, fn.type, d.type_cache.unit);
@@ -451,10 +740,234 @@ EnvData create_env_data(NativeRegistry r) {
 
   const SrcRef ref = {SrcID{0}, append_src(d.src, "#builtins")};
   d.native_module = append_root(d.ast, ASTTag::Module, ref, d.type_cache.unit, roots);
+  d.scripts_module = append_root(d.ast, ASTTag::Module, d.scripts_ref, d.type_cache.unit);
+  d.program = std::make_shared<const Program>(std::move(program));
+
+  d.type_table = transform_to_vec(d.native_types.names, Get<1>{});
+  for(const Type t : d.ast.tg.nodes()) {
+    const TypeID id = d.ast.tg.get<TypeID>(t);
+    if(id != TypeID{} && stdr::find(d.type_table, id) == d.type_table.end()) {
+      d.type_table.push_back(id);
+    }
+  }
+
+  // Fn types, names, purities and asyncness of the natives, native fns themselves can't be compared. Purity decides
+  // what scripts fold ahead of time so changing it invalidates them.
+  BinaryWriter w;
+  [[maybe_unused]] const auto result = write(w, d.type_table, d.ast);
+  assert(result);
+  for(const Purity purity : d.program->fn_purities) {
+    w.write(purity);
+  }
+  for(const bool async : d.program->fn_asyncs) {
+    w.write(async);
+  }
+  d.native_signature = stable_hash(std::move(w).bytes(), stable_hash(d.src));
 
   return d;
 }
 
+u64 cache_key(const EnvData& env, Span<std::string_view> files) {
+  return knot::accumulate(files, stable_hash(std::to_string(env.native_signature)), [](u64 h, std::string_view file) {
+    return stable_hash(file, stable_hash(std::to_string(file.size()), h));
+  });
+}
+
+constexpr u32 CacheMagic = 0x637a6f6f;
+constexpr u32 CacheVersion = 3;
+
+// Owned and borrowed inputs of every native, which folded values are checked against before being recomputed
+std::vector<std::pair<int, int>> native_input_counts(const EnvData& env) {
+  std::vector<std::pair<int, int>> counts(env.program->fns.size());
+  for(const auto& [id, inst] : env.fns) {
+    if(inst.get() < std::ssize(counts)) {
+      for(const Type arg : env.ast.tg.fanout(env.ast.tg.fanout(env.ast.types[id.get()])[0])) {
+        (env.ast.tg.get<TypeTag>(arg) == TypeTag::Borrow ? counts[inst.get()].second : counts[inst.get()].first)++;
+      }
+    }
+  }
+  return counts;
+}
+
+StringResult<std::vector<std::byte>> serialize_scripts(const EnvData& env, Span<std::string_view> files) {
+  if(!env.bindings.empty()) {
+    return err("Cannot serialize an env with bindings");
+  }
+
+  BinaryWriter w;
+  w.write(CacheMagic);
+  w.write(CacheVersion);
+  w.write(cache_key(env, files));
+  w.write(std::string_view(env.src));
+
+  return write(w, env.type_table, env.ast)
+    .and_then([&]() { return write(w, flatten(*env.program)); })
+    .map([&]() {
+      w.write(u64(env.fns.size()));
+      for(const auto& [id, inst] : env.fns) {
+        w.write(id.get());
+        w.write(inst.get());
+      }
+
+      w.write(u64(env.parsed_roots.size()));
+      for(const ASTID root : env.parsed_roots) {
+        w.write(root.get());
+      }
+
+      return std::move(w).bytes();
+    });
+}
+
+StringResult<void, EnvData> deserialize_scripts(EnvData env, Span<std::byte> bytes, Span<std::string_view> files) {
+  if(!env.parsed_roots.empty() || env.program->inst.size() != env.program->fns.size()) {
+    return {err("Scripts can only be deserialized into a fresh env"), std::move(env)};
+  }
+
+  BinaryReader r(bytes);
+  if(r.read<u32>() != CacheMagic || r.read<u32>() != CacheVersion || r.read<u64>() != cache_key(env, files)) {
+    return {err("Serialized scripts are out of date"), std::move(env)};
+  }
+
+  std::string src = r.read_string();
+  AST ast = read_ast(r, env.type_table);
+
+  Program natives;
+  natives.fns = env.program->fns;
+  natives.fn_costs = env.program->fn_costs;
+  natives.fn_purities = env.program->fn_purities;
+  natives.fn_asyncs = env.program->fn_asyncs;
+  Program program = read_program(r, std::move(natives), native_input_counts(env));
+
+  Map<ASTID, Inst> fns;
+  const size_t fn_count = r.read_size();
+  for(size_t i = 0; i < fn_count && r.ok(); i++) {
+    const ASTID id = ASTID(r.read<i32>());
+    fns.emplace(id, Inst(r.read<i32>()));
+  }
+
+  std::vector<ASTID> parsed_roots;
+  const size_t root_count = r.read_size();
+  for(size_t i = 0; i < root_count && r.ok(); i++) {
+    parsed_roots.push_back(ASTID(r.read<i32>()));
+  }
+
+  if(!r.ok() || !r.done()) {
+    return {err("Serialized scripts are corrupt"), std::move(env)};
+  }
+
+  env.src = std::move(src);
+  env.ast = std::move(ast);
+  env.program = std::make_shared<const Program>(std::move(program));
+  env.fns = std::move(fns);
+  env.parsed_roots = std::move(parsed_roots);
+
+  return std::move(env);
+}
+
+std::vector<TypeID> leaf_type_ids(const TypeGraph& tg, Type type, std::vector<TypeID> ids = {}) {
+  preorder(tg, type, [&](Type t) {
+    switch(tg.get<TypeTag>(t)) {
+    case TypeTag::Leaf: ids.push_back(tg.get<TypeID>(t)); return false;
+    case TypeTag::Fn: ids.push_back(TypeID{}); return false;
+    case TypeTag::Borrow:
+    case TypeTag::Tuple: return true;
+    case TypeTag::Floating: assert(false); return false;
+    }
+    assert(false);
+    return false;
+  });
+
+  return ids;
+}
+
+// Leaves under a borrow are borrowed inputs wherever they are in the arg, the rest are owned
+void add_input_type_ids(const TypeGraph& tg, Type arg, CompiledFn& fn) {
+  preorder(tg, arg, [&](Type t) {
+    switch(tg.get<TypeTag>(t)) {
+    case TypeTag::Tuple: return true;
+    case TypeTag::Borrow: fn.borrowed_inputs = leaf_type_ids(tg, t, std::move(fn.borrowed_inputs)); return false;
+    case TypeTag::Leaf:
+    case TypeTag::Fn: fn.owned_inputs = leaf_type_ids(tg, t, std::move(fn.owned_inputs)); return false;
+    case TypeTag::Floating: assert(false); return false;
+    }
+    assert(false);
+    return false;
+  });
+}
+
+CompiledEnvData compile(const EnvData& env) {
+  const AST& ast = env.ast;
+  const auto srcs = make_sv_array(env.src);
+
+  CompiledEnvData compiled{env.program, env.native_types.names, {}};
+
+  const auto handle_id = [&](auto self, ASTID id) -> void {
+    if(ast.forest[id] == ASTTag::Assignment) {
+      const ASTID ident = *ast.forest.first_child(id);
+      if(const auto it = env.fns.find(ident); it != env.fns.end()) {
+        const Type type = ast.types[ident.get()];
+        const Type args = ast.tg.fanout(type)[0];
+        const Type result = ast.tg.fanout(type)[1];
+
+        CompiledFn& fn = compiled.fns.emplace_back(CompiledFn{std::string(sv(srcs, ast.srcs[ident.get()])),
+                                                              ooze::pretty_print(ast.tg, env.native_types.names, type),
+                                                              it->second});
+        add_input_type_ids(ast.tg, args, fn);
+        fn.outputs = size_of(ast.tg, result);
+      }
+    } else if(ast.forest[id] == ASTTag::Module) {
+      for(const ASTID id : ast.forest.child_ids(id)) {
+        self(self, id);
+      }
+    }
+  };
+
+  for(const ASTID id : ast.forest.root_ids()) {
+    handle_id(handle_id, id);
+  }
+
+  stdr::sort(compiled.fns, std::less{}, &CompiledFn::name);
+  return compiled;
+}
+
+StringResult<const CompiledFn*> find_fn(const CompiledEnvData& compiled, std::string_view name, std::string_view type) {
+  const auto [begin, end] = stdr::equal_range(compiled.fns, name, std::less{}, &CompiledFn::name);
+  const auto matches = [&](const CompiledFn& fn) { return type.empty() || fn.type == type; };
+
+  const auto it = std::find_if(begin, end, matches);
+  if(it == end) {
+    return err(fmt::format("no fn {}{}{}", name, type.empty() ? "" : ": ", type));
+  } else if(std::find_if(std::next(it), end, matches) != end) {
+    return err(fmt::format("{} is overloaded, specify its type", name));
+  }
+
+  return &*it;
+}
+
+StringResult<void> check_input_types(const TypeNames& names,
+                                     std::string_view name,
+                                     std::string_view kind,
+                                     const std::vector<TypeID>& expected,
+                                     const std::vector<TypeID>& given) {
+  if(expected.size() != given.size()) {
+    return err(fmt::format("{} takes {} {}inputs, given {}", name, expected.size(), kind, given.size()));
+  }
+
+  std::vector<std::string> errors;
+  for(size_t i = 0; i < expected.size(); i++) {
+    if(expected[i] != given[i]) {
+      errors.push_back(fmt::format("{} {}input {} is a {}, given a {}",
+                                   name,
+                                   kind,
+                                   i,
+                                   pretty_print(names, expected[i]),
+                                   pretty_print(names, given[i])));
+    }
+  }
+
+  return errors.empty() ? StringResult<void>{} : StringResult<void>{Failure{std::move(errors)}};
+}
+
 } // namespace
 
 NativeRegistry create_primitive_registry() {
@@ -473,19 +986,76 @@ NativeRegistry create_primitive_registry() {
     .add_type<std::string>("string")
     .add_type<std::vector<std::string>>("string_vector")
     .add_type<std::vector<std::byte>>("byte_vector")
-    .add_fn("to_string", [](const bool& x) { return fmt::format("{}", x); })
-    .add_fn("to_string", [](const i8& x) { return fmt::format("{}", x); })
-    .add_fn("to_string", [](const i16& x) { return fmt::format("{}", x); })
-    .add_fn("to_string", [](const i32& x) { return fmt::format("{}", x); })
-    .add_fn("to_string", [](const i64& x) { return fmt::format("{}", x); })
-    .add_fn("to_string", [](const u8& x) { return fmt::format("{}", x); })
-    .add_fn("to_string", [](const u16& x) { return fmt::format("{}", x); })
-    .add_fn("to_string", [](const u32& x) { return fmt::format("{}", x); })
-    .add_fn("to_string", [](const u64& x) { return fmt::format("{}", x); })
-    .add_fn("to_string", [](const f32& x) { return fmt::format("{}", x); })
-    .add_fn("to_string", [](const f64& x) { return fmt::format("{}", x); })
-    .add_fn("to_string", [](const std::string& x) { return fmt::format("{}", x); })
-    .add_fn("println", [](const std::string& s) { fmt::println("{}", s); });
+    .add_fn("to_string", [](const bool& x) { return fmt::format("{}", x); }, Cost::Unknown, Purity::Pure)
+    .add_fn("to_string", [](const i8& x) { return fmt::format("{}", x); }, Cost::Unknown, Purity::Pure)
+    .add_fn("to_string", [](const i16& x) { return fmt::format("{}", x); }, Cost::Unknown, Purity::Pure)
+    .add_fn("to_string", [](const i32& x) { return fmt::format("{}", x); }, Cost::Unknown, Purity::Pure)
+    .add_fn("to_string", [](const i64& x) { return fmt::format("{}", x); }, Cost::Unknown, Purity::Pure)
+    .add_fn("to_string", [](const u8& x) { return fmt::format("{}", x); }, Cost::Unknown, Purity::Pure)
+    .add_fn("to_string", [](const u16& x) { return fmt::format("{}", x); }, Cost::Unknown, Purity::Pure)
+    .add_fn("to_string", [](const u32& x) { return fmt::format("{}", x); }, Cost::Unknown, Purity::Pure)
+    .add_fn("to_string", [](const u64& x) { return fmt::format("{}", x); }, Cost::Unknown, Purity::Pure)
+    .add_fn("to_string", [](const f32& x) { return fmt::format("{}", x); }, Cost::Unknown, Purity::Pure)
+    .add_fn("to_string", [](const f64& x) { return fmt::format("{}", x); }, Cost::Unknown, Purity::Pure)
+    .add_fn("to_string", [](const std::string& x) { return fmt::format("{}", x); }, Cost::Unknown, Purity::Pure)
+    .add_fn("println", [](const std::string& s) { fmt::println("{}", s); }, Cost::Unknown, Purity::Impure);
+}
+
+CompiledEnv::CompiledEnv(std::shared_ptr<const CompiledEnvData> data) : _data(std::move(data)) {}
+
+StringResult<std::vector<Future>> CompiledEnv::call(Executor& ex,
+                                                    std::string_view name,
+                                                    std::vector<std::pair<Future, TypeID>> inputs,
+                                                    std::vector<std::pair<BorrowedFuture, TypeID>> borrowed_inputs,
+                                                    std::string_view type) const {
+  return find_fn(*_data, name, type)
+    .and_then([&](const CompiledFn* fn) {
+      return check_input_types(_data->type_names, name, "", fn->owned_inputs, transform_to_vec(inputs, Get<1>{}))
+        .and_then([&]() {
+          return check_input_types(
+            _data->type_names, name, "borrowed ", fn->borrowed_inputs, transform_to_vec(borrowed_inputs, Get<1>{}));
+        })
+        .map([&]() { return fn; });
+    })
+    .map([&](const CompiledFn* fn) {
+      std::vector<Future> results(fn->outputs);
+      execute(_data->program,
+              fn->inst,
+              ex,
+              transform_to_vec(std::move(inputs), Get<0>{}),
+              transform_to_vec(std::move(borrowed_inputs), Get<0>{}),
+              results);
+      return results;
+    });
+}
+
+StringResult<void> CompiledEnv::stream(Executor& ex,
+                                       std::string_view name,
+                                       int window,
+                                       const std::function<std::optional<std::vector<Any>>()>& source,
+                                       const std::function<void(std::vector<Any>)>& sink,
+                                       std::string_view type) const {
+  return find_fn(*_data, name, type).and_then([&](const CompiledFn* fn) -> StringResult<void> {
+    if(!fn->borrowed_inputs.empty()) {
+      return err(fmt::format("{} borrows its inputs, only fns taking owned inputs can be streamed", name));
+    } else if(window < 1) {
+      return err(fmt::format("stream window must be at least 1, given {}", window));
+    }
+
+    // Inputs of the wrong type end the stream early, everything pulled before them still runs
+    StringResult<void> checked;
+    const auto checked_source = [&]() -> std::optional<std::vector<Any>> {
+      std::optional<std::vector<Any>> inputs = source();
+      if(inputs) {
+        const auto types = transform_to_vec(*inputs, [](const Any& a) { return a.type(); });
+        checked = check_input_types(_data->type_names, name, "", fn->owned_inputs, types);
+      }
+      return checked ? std::move(inputs) : std::nullopt;
+    };
+
+    execute_stream(_data->program, fn->inst, ex, window, checked_source, sink);
+    return checked;
+  });
 }
 
 Env::Env() : _data(create_env_data(NativeRegistry{})) {}
@@ -502,37 +1072,86 @@ StringResult<void, Env> Env::parse_scripts(Span<std::string_view> files) && {
   });
 }
 
+StringResult<std::vector<std::byte>> Env::serialize_scripts(Span<std::string_view> files) const {
+  return ooze::serialize_scripts(*_data, files);
+}
+
+StringResult<void> Env::deserialize_scripts(Span<std::byte> bytes, Span<std::string_view> files) & {
+  return ooze::deserialize_scripts(std::move(*_data), bytes, files).map_state([&](auto d) {
+    *_data = std::move(d);
+  });
+}
+
 StringResult<Binding> Env::run(Executor& ex, std::string_view expr) & {
-  return ooze::run(ex, std::move(*_data), expr).map_state([&](EnvData env) { *_data = std::move(env); });
+  const i64 since = _data->next_derivation;
+  return react(ex, since, ooze::run(ex, std::move(*_data), expr)).map_state([&](EnvData env) {
+    *_data = std::move(env);
+  });
 }
 
 StringResult<Binding, Env> Env::run(Executor& ex, std::string_view expr) && {
-  return ooze::run(ex, std::move(*_data), expr).map_state([&](EnvData env) {
+  const i64 since = _data->next_derivation;
+  return react(ex, since, ooze::run(ex, std::move(*_data), expr)).map_state([&](EnvData env) {
     *_data = std::move(env);
     return std::move(*this);
   });
 }
 
 StringResult<Future> Env::run_to_string(Executor& ex, std::string_view expr) & {
-  return ooze::run_to_string(ex, std::move(*_data), expr).map_state([&](EnvData env) { *_data = std::move(env); });
+  const i64 since = _data->next_derivation;
+  return react(ex, since, ooze::run_to_string(ex, std::move(*_data), expr)).map_state([&](EnvData env) {
+    *_data = std::move(env);
+  });
 }
 
 StringResult<Future, Env> Env::run_to_string(Executor& ex, std::string_view expr) && {
-  return ooze::run_to_string(ex, std::move(*_data), expr).map_state([&](EnvData env) {
+  const i64 since = _data->next_derivation;
+  return react(ex, since, ooze::run_to_string(ex, std::move(*_data), expr)).map_state([&](EnvData env) {
     *_data = std::move(env);
     return std::move(*this);
   });
 }
 
-bool Env::drop(std::string_view binding) { return _data->bindings.erase(std::string(binding)) > 0; }
+CompiledEnv Env::compile() const { return CompiledEnv(std::make_shared<const CompiledEnvData>(ooze::compile(*_data))); }
+
+bool Env::drop(std::string_view binding) {
+  forget_derivation(*_data, std::string(binding));
+  return _data->bindings.erase(std::string(binding)) > 0;
+}
 
-void Env::insert(std::string_view name, Binding binding) { _data->bindings.emplace(name, std::move(binding)); }
+void Env::insert(std::string_view name, Binding binding) {
+  if(_data->bindings.emplace(name, std::move(binding)).second) {
+    forget_derivation(*_data, std::string(name));
+  }
+}
 
 void Env::insert(std::string_view name, Future f, TypeID type_id) {
   const Type type = _data->ast.tg.add_node(TypeTag::Leaf, type_id);
-  _data->bindings.emplace(name, Binding{type, make_vector(AsyncValue{std::move(f)})});
+  insert(name, Binding{type, make_vector(AsyncValue{std::move(f)})});
 }
 
+StringResult<void> Env::insert(Executor& ex, std::string_view name, Binding binding) {
+  forget_derivation(*_data, std::string(name));
+  _data->bindings.insert_or_assign(std::string(name), std::move(binding));
+
+  if(!_data->reactive) {
+    return {};
+  }
+
+  const i64 until = _data->next_derivation;
+  return recompute(ex, std::move(*_data), make_vector(std::string(name)), until).map_state([&](EnvData env) {
+    *_data = std::move(env);
+  });
+}
+
+StringResult<void> Env::insert(Executor& ex, std::string_view name, Future f, TypeID type_id) {
+  const Type type = _data->ast.tg.add_node(TypeTag::Leaf, type_id);
+  return insert(ex, name, Binding{type, make_vector(AsyncValue{std::move(f)})});
+}
+
+void Env::set_reactive(bool reactive) { _data->reactive = reactive; }
+bool Env::reactive() const { return _data->reactive; }
+
 StringResult<void> Env::type_check(std::string_view expr, std::string_view hint) const {
   const auto srcs = make_sv_array(_data->src, hint, expr);
   return parse_and_name_resolution(ooze::parse_type, srcs, _data->native_types.names, std::move(_data->ast), SrcID{1})
@@ -549,7 +1168,7 @@ StringResult<void> Env::type_check(std::string_view expr, std::string_view hint)
                   _data->native_types,
                   std::move(ast),
                   std::array{expr},
-                  std::array{_data->native_module});
+                  std::array{_data->native_module, _data->scripts_module});
     })
     .map_state(nullify())
     .map(nullify())
@@ -558,7 +1177,11 @@ StringResult<void> Env::type_check(std::string_view expr, std::string_view hint)
 
 StringResult<void> Env::type_check_fn(std::string_view fn) const {
   const auto srcs = make_sv_array(_data->src, fn);
-  return frontend(parse_fn_expr, srcs, _data->native_types, _data->ast, std::array{_data->native_module})
+  return frontend(parse_fn_expr,
+                  srcs,
+                  _data->native_types,
+                  _data->ast,
+                  std::array{_data->native_module, _data->scripts_module})
     .map_state(nullify())
     .map(nullify())
     .map_error([&](std::vector<ContextualError> errors) { return contextualize(srcs, std::move(errors)); });
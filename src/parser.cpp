@@ -130,11 +130,13 @@ struct TypeAppender {
   }
 
   Type operator()(State& s, Span<Token> tokens, Slice ref, Span<Type> ids) const {
-    const Type n = s.ast.tg.add_node(ids, _tag, {});
     if(_tag == TypeTag::Leaf) {
+      const Type n = s.ast.tg.add_unnamed_leaf();
       s.type_srcs.emplace_back(n, SrcRef{s.src_id, char_slice(tokens, ref)});
+      return n;
+    } else {
+      return s.ast.tg.add_node(ids, _tag, {});
     }
-    return n;
   }
 };
 
@@ -0,0 +1,165 @@
+#include "pch.h"
+
+#include "profiler.h"
+
+#include <map>
+
+namespace ooze {
+
+namespace {
+
+std::atomic<Profiler*> active = nullptr;
+std::atomic<u64> next_generation = 1;
+
+std::string escape_json(std::string_view str) {
+  std::string escaped;
+  escaped.reserve(str.size());
+  for(char c : str) {
+    if(c == '"' || c == '\\') {
+      escaped.push_back('\\');
+    }
+    escaped.push_back(c);
+  }
+  return escaped;
+}
+
+i64 to_us(std::chrono::steady_clock::duration d) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+}
+
+InstOp op(const ProfileEvent& e) { return e.program->inst[e.program->index(e.inst)]; }
+
+// Script fns are curried with the fns they reference so their names also apply to the curried insts
+Map<Inst, std::string> inst_names(const Program& p) {
+  Map<Inst, std::string> names;
+  for(const Program* layer = &p; layer; layer = layer->base.get()) {
+    names.insert(layer->names.begin(), layer->names.end());
+  }
+
+  for(const auto& [fn, name] : Map<Inst, std::string>(names)) {
+    Inst inst = fn;
+    for(const Program* owner = &p.owner(inst); owner->inst[owner->index(inst)] == InstOp::Curry;) {
+      inst = owner->currys[owner->inst_data[owner->index(inst)]].first;
+      owner = &owner->owner(inst);
+      names.emplace(inst, name);
+    }
+  }
+  return names;
+}
+
+class EventNames {
+  Map<const Program*, Map<Inst, std::string>> _names;
+
+public:
+  const std::string& operator()(const ProfileEvent& e) {
+    auto it = _names.find(e.program);
+    if(it == _names.end()) {
+      it = _names.emplace(e.program, inst_names(*e.program)).first;
+    }
+
+    auto name_it = it->second.find(e.inst);
+    if(name_it == it->second.end()) {
+      name_it = it->second.emplace(e.inst, fmt::format("{}#{}", knot::debug(op(e)), e.inst.get())).first;
+    }
+
+    return name_it->second;
+  }
+};
+
+} // namespace
+
+Profiler::Profiler() : _generation(next_generation.fetch_add(1)) {}
+
+Profiler::ThreadEvents& Profiler::thread_events() {
+  // Generations instead of pointers since a new profiler can reuse the address of an old one
+  thread_local u64 generation = 0;
+  thread_local ThreadEvents* events = nullptr;
+
+  if(generation != _generation) {
+    const std::lock_guard lock(_mutex);
+    _threads.push_back(std::make_unique<ThreadEvents>(ThreadEvents{int(_threads.size())}));
+    generation = _generation;
+    events = _threads.back().get();
+  }
+
+  return *events;
+}
+
+void Profiler::retain(std::shared_ptr<const Program> p) {
+  const std::lock_guard lock(_mutex);
+  _programs.push_back(std::move(p));
+}
+
+std::vector<ProfileEvent> Profiler::events() const {
+  const std::lock_guard lock(_mutex);
+
+  std::vector<ProfileEvent> events;
+  for(const auto& thread : _threads) {
+    events.insert(events.end(), thread->events.begin(), thread->events.end());
+  }
+
+  stdr::sort(events, [](const ProfileEvent& x, const ProfileEvent& y) { return x.start < y.start; });
+
+  return events;
+}
+
+Profiler* active_profiler() { return active.load(std::memory_order_relaxed); }
+void set_active_profiler(Profiler* p) { active.store(p, std::memory_order_relaxed); }
+
+std::string chrome_trace(const Profiler& profiler) {
+  const std::vector<ProfileEvent> events = profiler.events();
+  EventNames names;
+
+  std::string trace = "{\"traceEvents\":[";
+  for(size_t i = 0; i < events.size(); i++) {
+    const ProfileEvent& e = events[i];
+    trace += fmt::format("{}\n{{\"name\":\"{}\",\"ph\":\"X\",\"ts\":{},\"dur\":{},\"pid\":0,\"tid\":{},"
+                         "\"args\":{{\"inst\":{}}}}}",
+                         i == 0 ? "" : ",",
+                         escape_json(names(e)),
+                         to_us(e.start - profiler.epoch()),
+                         to_us(e.end - e.start),
+                         e.thread,
+                         e.inst.get());
+  }
+  trace += "\n]}\n";
+
+  return trace;
+}
+
+std::string collapsed_stacks(const Profiler& profiler) {
+  const std::vector<ProfileEvent> events = profiler.events();
+  EventNames names;
+
+  Map<ProfileID, const ProfileEvent*> by_id;
+  for(const ProfileEvent& e : events) {
+    if(e.id != 0) {
+      by_id.emplace(e.id, &e);
+    }
+  }
+
+  // Only fns and values do any work themselves, graphs show up as the frames above them
+  std::map<std::string, i64> stacks;
+  for(const ProfileEvent& e : events) {
+    if(op(e) != InstOp::Fn && op(e) != InstOp::Value) {
+      continue;
+    }
+
+    std::string stack = names(e);
+    for(auto it = by_id.find(e.parent); it != by_id.end(); it = by_id.find(it->second->parent)) {
+      stack = fmt::format("{};{}", names(*it->second), stack);
+    }
+
+    stacks[std::move(stack)] +=
+      std::chrono::duration_cast<std::chrono::nanoseconds>(e.end - e.start).count();
+  }
+
+  std::string output;
+  for(const auto& [stack, ns] : stacks) {
+    output += fmt::format("{} {}\n", stack, ns);
+  }
+
+  return output;
+}
+
+} // namespace ooze
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "program.h"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace ooze {
+
+// Identifies a dispatch so the dispatches nested within it can refer to it, 0 is the root
+using ProfileID = u64;
+
+struct ProfileEvent {
+  ProfileID id = 0;
+  ProfileID parent = 0;
+  const Program* program = nullptr;
+  Inst inst;
+  int thread = 0;
+  std::chrono::steady_clock::time_point start;
+  std::chrono::steady_clock::time_point end;
+};
+
+// Records every instruction dispatched by the runtime while it is the active profiler
+class Profiler {
+  struct ThreadEvents {
+    int thread = 0;
+    std::vector<ProfileEvent> events;
+  };
+
+  u64 _generation;
+  std::chrono::steady_clock::time_point _epoch = std::chrono::steady_clock::now();
+  std::atomic<ProfileID> _next_id = 1;
+
+  mutable std::mutex _mutex;
+  std::vector<std::unique_ptr<ThreadEvents>> _threads;
+  std::vector<std::shared_ptr<const Program>> _programs;
+
+  ThreadEvents& thread_events();
+
+public:
+  Profiler();
+
+  Profiler(const Profiler&) = delete;
+  Profiler& operator=(const Profiler&) = delete;
+
+  ProfileID next_id() { return _next_id.fetch_add(1, std::memory_order_relaxed); }
+  int thread() { return thread_events().thread; }
+
+  void record(const ProfileEvent& e) { thread_events().events.push_back(e); }
+
+  // Keeps the program alive so instructions can still be named once it's done executing
+  void retain(std::shared_ptr<const Program>);
+
+  std::chrono::steady_clock::time_point epoch() const { return _epoch; }
+
+  // Only valid once everything being profiled has finished executing
+  std::vector<ProfileEvent> events() const;
+};
+
+Profiler* active_profiler();
+void set_active_profiler(Profiler*);
+
+std::string chrome_trace(const Profiler&);
+std::string collapsed_stacks(const Profiler&);
+
+} // namespace ooze
@@ -10,23 +10,192 @@ Inst add_internal(Program& p, InstOp op, int output_count, int inst_data = -1) {
   p.inst.push_back(op);
   p.output_counts.push_back(output_count);
   p.inst_data.push_back(inst_data);
-  return Inst{i32(p.inst.size() - 1)};
+  return Inst{p.offset + i32(p.inst.size() - 1)};
+}
+
+// Insts already visited contribute nothing new, so recursive programs terminate
+bool has_side_effects(const Program& p, Inst inst, Set<Inst>& visited) {
+  if(!visited.insert(inst).second) {
+    return false;
+  }
+
+  const Program& owner = p.owner(inst);
+  const i32 idx = owner.index(inst);
+
+  switch(owner.inst[idx]) {
+  case InstOp::Value: return false;
+  case InstOp::Fn: {
+    const Purity purity = owner.fn_purities[owner.inst_data[idx]];
+    return purity == Purity::Impure || (purity == Purity::Unknown && owner.output_counts[idx] == 0);
+  }
+  case InstOp::Graph:
+    return stdr::any_of(owner.graphs[owner.inst_data[idx]].insts,
+                        [&](Inst i) { return has_side_effects(p, i, visited); });
+  case InstOp::If: {
+    const IfInst& if_inst = owner.ifs[owner.inst_data[idx]];
+    return has_side_effects(p, if_inst.if_inst, visited) || has_side_effects(p, if_inst.else_inst, visited);
+  }
+  case InstOp::Curry: return has_side_effects(p, owner.currys[owner.inst_data[idx]].first, visited);
+  case InstOp::Functional:
+  case InstOp::Placeholder: return true;
+  }
+
+  return true;
 }
 
 } // namespace
 
+FrameLayout make_frame_layout(const FunctionGraph& g) {
+  FrameLayout layout{{0}, {0}, {}, {}, 0};
+
+  for(const auto [owned, borrowed] : g.input_counts) {
+    layout.input_offsets.push_back(layout.input_offsets.back() + owned);
+    layout.borrow_offsets.push_back(layout.borrow_offsets.back() + borrowed);
+    layout.counts.push_back(owned + borrowed);
+  }
+
+  // Ensure output never executes
+  layout.input_offsets.push_back(layout.input_offsets.back() + g.output_count);
+  layout.counts.push_back(g.output_count + 1);
+
+  // Ensure tailcall never executes
+  if(g.tailcall) {
+    layout.counts[*g.tailcall]++;
+  }
+
+  layout.output_offsets.push_back(layout.input_offsets.back());
+  for(int i = 1; i < std::ssize(g.owned_fwds); i++) {
+    layout.output_offsets.push_back(layout.output_offsets.back() + int(g.owned_fwds[i].size()));
+  }
+
+  for(const BorrowCleanup& cleanup : g.borrow_cleanups) {
+    layout.counts.push_back(cleanup.count);
+  }
+
+  layout.value_count = layout.output_offsets.back() + int(g.borrow_cleanups.size());
+
+  // Replay how values are forwarded at runtime to find the order in which nodes become ready
+  std::vector<int> counts = layout.counts;
+
+  const auto fwd = [&](Term t) {
+    if(--counts[t.node_id] == 0) {
+      layout.order.push_back(t.node_id);
+    }
+  };
+
+  const auto fwd_all = [&](const ValueForward& f) {
+    for(int u = 0; u < f.copy_end; u++) {
+      fwd(f.terms[u]);
+    }
+
+    if(f.move_end != std::ssize(f.terms)) {
+      for(int u = f.move_end; u < std::ssize(f.terms); u++) {
+        fwd(f.terms[u]);
+      }
+    } else if(f.copy_end != f.move_end) {
+      fwd(f.terms[f.copy_end]);
+    }
+  };
+
+  for(int i = 0; i < std::ssize(g.input_counts); i++) {
+    if(layout.counts[i] == 0) {
+      layout.order.push_back(i);
+    }
+  }
+
+  stdr::for_each(g.owned_fwds.front(), fwd_all);
+  stdr::for_each(g.input_borrowed_fwds, fwd_all);
+
+  const size_t cleanup_offset = layout.input_offsets.size() - 1;
+  for(size_t i = 0; i < layout.order.size(); i++) {
+    const int node = layout.order[i];
+    stdr::for_each(g.owned_fwds[node + 1], fwd_all);
+
+    for(const int cleanup_idx : g.node_borrows[node]) {
+      if(--counts[cleanup_offset + cleanup_idx] == 0 && g.borrow_cleanups[cleanup_idx].fwd) {
+        fwd(*g.borrow_cleanups[cleanup_idx].fwd);
+      }
+    }
+  }
+
+  // Walking the order backwards visits every node after the nodes depending on it, only the output and tail call
+  // never show up in the order
+  layout.critical_path.assign(g.insts.size() + 1, 0);
+  if(g.tailcall) {
+    layout.critical_path[*g.tailcall] = 1;
+  }
+
+  for(auto it = layout.order.rbegin(); it != layout.order.rend(); ++it) {
+    const int node = *it;
+    int longest = 0;
+
+    for(const ValueForward& f : g.owned_fwds[node + 1]) {
+      for(const Term t : f.terms) {
+        longest = std::max(longest, layout.critical_path[t.node_id]);
+      }
+    }
+
+    for(const int cleanup_idx : g.node_borrows[node]) {
+      if(const auto f = g.borrow_cleanups[cleanup_idx].fwd; f) {
+        longest = std::max(longest, layout.critical_path[f->node_id]);
+      }
+    }
+
+    layout.critical_path[node] = longest + 1;
+  }
+  layout.critical_path.pop_back();
+
+  return layout;
+}
+
+bool has_side_effects(const Program& p, Inst inst) {
+  Set<Inst> visited;
+  return has_side_effects(p, inst, visited);
+}
+
+std::optional<std::vector<Any>> evaluate(const Program& p, Inst fn, Span<Inst> values, Span<Inst> borrows) {
+  const Program& owner = p.owner(fn);
+  const i32 idx = owner.index(fn);
+
+  const auto value_of = [&](Inst i) -> const Any& {
+    const Program& value_owner = p.owner(i);
+    return value_owner.values[value_owner.inst_data[value_owner.index(i)]];
+  };
+
+  std::vector<Any> inputs = transform_to_vec(values, value_of);
+  std::vector<const Any*> borrowed_inputs = transform_to_vec(borrows, [&](Inst i) { return &value_of(i); });
+  std::vector<Any> outputs(owner.output_counts[idx]);
+
+  try {
+    owner.fns[owner.inst_data[idx]](inputs, borrowed_inputs, outputs.data());
+    [[maybe_unused]] const std::vector<Any> copies = outputs;
+  } catch(const std::exception&) {
+    return std::nullopt;
+  }
+
+  return outputs;
+}
+
+Program::Program(std::shared_ptr<const Program> b)
+    : base(std::move(b)), offset(base->offset + i32(base->inst.size())), max_arity(base->max_arity) {}
+
 Inst Program::add(Any a) {
   values.push_back(std::move(a));
   return add_internal(*this, InstOp::Value, 1, i32(values.size() - 1));
 }
 
-Inst Program::add(AnyFn fn, int output_count) {
+Inst Program::add(AnyFn fn, int output_count, Cost cost, Purity purity, bool async) {
   fns.push_back(std::move(fn));
+  fn_costs.emplace_back(cost);
+  fn_purities.push_back(purity);
+  fn_asyncs.push_back(async);
   return add_internal(*this, InstOp::Fn, output_count, i32(fns.size() - 1));
 }
 
 Inst Program::add(FunctionGraph g) {
   const Inst i = add_internal(*this, InstOp::Graph, g.output_count, i32(graphs.size()));
+  max_arity = std::max(max_arity, i32(g.input_borrows.size()));
+  frames.push_back(make_frame_layout(g));
   graphs.push_back(std::move(g));
   return i;
 }
@@ -40,7 +209,8 @@ Inst Program::add(IfInst inst, int output_count) {
 }
 
 Inst Program::curry(Inst curried, Span<Any> s) {
-  const Inst i = add_internal(*this, InstOp::Curry, output_counts[curried.get()], i32(currys.size()));
+  const Program& owner_p = owner(curried);
+  const Inst i = add_internal(*this, InstOp::Curry, owner_p.output_counts[owner_p.index(curried)], i32(currys.size()));
   currys.emplace_back(curried, Slice{i32(values.size()), i32(values.size() + s.size())});
   values.insert(values.end(), std::make_move_iterator(s.begin()), std::make_move_iterator(s.end()));
   return i;
@@ -49,20 +219,70 @@ Inst Program::curry(Inst curried, Span<Any> s) {
 Inst Program::placeholder() { return add_internal(*this, InstOp::Placeholder, -1, -1); }
 
 void Program::set(Inst i, FunctionGraph g) {
-  assert(inst[i.get()] == InstOp::Placeholder);
-  inst[i.get()] = InstOp::Graph;
-  output_counts[i.get()] = g.output_count;
-  inst_data[i.get()] = i32(graphs.size());
+  const i32 idx = index(i);
+  assert(inst[idx] == InstOp::Placeholder);
+  inst[idx] = InstOp::Graph;
+  output_counts[idx] = g.output_count;
+  inst_data[idx] = i32(graphs.size());
+  max_arity = std::max(max_arity, i32(g.input_borrows.size()));
+  frames.push_back(make_frame_layout(g));
   graphs.push_back(std::move(g));
 }
 
 void Program::set(Inst i, Inst curried, Span<Any> s) {
-  assert(inst[i.get()] == InstOp::Placeholder);
-  inst[i.get()] = InstOp::Curry;
-  output_counts[i.get()] = output_counts[curried.get()];
-  inst_data[i.get()] = i32(currys.size());
+  const i32 idx = index(i);
+  const Program& owner_p = owner(curried);
+  assert(inst[idx] == InstOp::Placeholder);
+  inst[idx] = InstOp::Curry;
+  output_counts[idx] = owner_p.output_counts[owner_p.index(curried)];
+  inst_data[idx] = i32(currys.size());
   currys.emplace_back(curried, Slice{i32(values.size()), i32(values.size() + s.size())});
   values.insert(values.end(), std::make_move_iterator(s.begin()), std::make_move_iterator(s.end()));
 }
 
+Program flatten(const Program& p) {
+  Program flat = p.base ? flatten(*p.base) : Program{};
+
+  const auto append = [](auto& dst, const auto& src) { dst.insert(dst.end(), src.begin(), src.end()); };
+
+  // Inst data indexes into the layer's own vectors so it's shifted past the layers below it
+  const auto shift = [&](InstOp op) -> i32 {
+    switch(op) {
+    case InstOp::Value: return i32(flat.values.size());
+    case InstOp::Fn: return i32(flat.fns.size());
+    case InstOp::Graph: return i32(flat.graphs.size());
+    case InstOp::If: return i32(flat.ifs.size());
+    case InstOp::Curry: return i32(flat.currys.size());
+    case InstOp::Functional:
+    case InstOp::Placeholder: return 0;
+    }
+    return 0;
+  };
+
+  for(size_t i = 0; i < p.inst.size(); i++) {
+    flat.inst_data.push_back(p.inst_data[i] + shift(p.inst[i]));
+  }
+
+  const i32 value_shift = i32(flat.values.size());
+  for(auto [curried, slice] : p.currys) {
+    flat.currys.emplace_back(curried, Slice{slice.begin + value_shift, slice.end + value_shift});
+  }
+
+  append(flat.inst, p.inst);
+  append(flat.output_counts, p.output_counts);
+  append(flat.values, p.values);
+  flat.folds.insert(p.folds.begin(), p.folds.end());
+  append(flat.fns, p.fns);
+  append(flat.fn_costs, p.fn_costs);
+  append(flat.fn_purities, p.fn_purities);
+  append(flat.fn_asyncs, p.fn_asyncs);
+  append(flat.graphs, p.graphs);
+  append(flat.frames, p.frames);
+  append(flat.ifs, p.ifs);
+  flat.names.insert(p.names.begin(), p.names.end());
+  flat.max_arity = p.max_arity;
+
+  return flat;
+}
+
 } // namespace ooze
@@ -5,8 +5,12 @@
 
 #include "ooze/any.h"
 #include "ooze/any_fn.h"
+#include "ooze/native_registry.h"
 #include "ooze/traits.h"
 
+#include <atomic>
+#include <chrono>
+#include <memory>
 #include <utility>
 #include <vector>
 
@@ -31,21 +35,127 @@ struct IfInst {
   std::array<i32, 2> borrow_offsets = {};
 };
 
+// Cost hint of a fn, refined with timings measured the first few times it runs
+class FnCost {
+  Cost _hint = Cost::Unknown;
+  mutable std::atomic<i32> _samples = 0;
+  mutable std::atomic<i64> _total_ns = 0;
+
+public:
+  static constexpr i32 Samples = 8;
+  static constexpr std::chrono::nanoseconds SpawnThreshold = std::chrono::microseconds(5);
+
+  FnCost() = default;
+  explicit FnCost(Cost hint) : _hint(hint) {}
+
+  FnCost(const FnCost& c) : _hint(c._hint), _samples(c._samples.load()), _total_ns(c._total_ns.load()) {}
+  FnCost& operator=(const FnCost& c) {
+    _hint = c._hint;
+    _samples = c._samples.load();
+    _total_ns = c._total_ns.load();
+    return *this;
+  }
+
+  bool measuring() const { return _hint == Cost::Unknown && _samples.load(std::memory_order_relaxed) < Samples; }
+
+  void record(std::chrono::nanoseconds duration) const {
+    _total_ns.fetch_add(duration.count(), std::memory_order_relaxed);
+    _samples.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // Unmeasured fns are spawned since they might be expensive
+  bool spawn() const {
+    switch(_hint) {
+    case Cost::Cheap: return false;
+    case Cost::Expensive: return true;
+    case Cost::Unknown: {
+      const i32 samples = _samples.load(std::memory_order_relaxed);
+      return samples == 0 ||
+             std::chrono::nanoseconds(_total_ns.load(std::memory_order_relaxed) / samples) >= SpawnThreshold;
+    }
+    }
+    return true;
+  }
+};
+
+// Slot offsets of every node within the single allocation backing an invocation of a FunctionGraph
+struct FrameLayout {
+  // Prefix sums of the owned and borrowed inputs of each node, the graph output being the last node
+  std::vector<int> input_offsets;
+  std::vector<int> borrow_offsets;
+
+  // Prefix sums of the outputs of each node, starting after all the inputs
+  std::vector<int> output_offsets;
+
+  // Initial ref count of each node followed by the count of each borrow cleanup
+  std::vector<int> counts;
+
+  // Outputs are followed by the values being borrowed by each borrow cleanup
+  int value_count = 0;
+
+  // Every node that can run, each after all the nodes it depends on
+  std::vector<int> order;
+
+  // Length of the longest chain of nodes from each node to the graph output, ready nodes are spawned by it
+  std::vector<int> critical_path;
+};
+
+FrameLayout make_frame_layout(const FunctionGraph&);
+
+// Pure fn call on value insts a value was folded from, values that can't be serialized are recomputed from it
+struct FoldedValue {
+  Inst fn;
+  std::vector<Inst> values;
+  std::vector<Inst> borrows;
+  i32 output = 0;
+};
+
 struct Program {
+  // Insts before offset live in the base, which is shared immutably and never refers to the insts after it
+  std::shared_ptr<const Program> base;
+  i32 offset = 0;
+
   std::vector<InstOp> inst;
   std::vector<i32> output_counts;
   std::vector<i32> inst_data;
 
   std::vector<Any> values;
+  Map<Inst, FoldedValue> folds;
   std::vector<AnyFn> fns;
+  std::vector<FnCost> fn_costs;
+  std::vector<Purity> fn_purities;
+  std::vector<bool> fn_asyncs;
   std::vector<FunctionGraph> graphs;
+  std::vector<FrameLayout> frames;
   std::vector<IfInst> ifs;
 
   // TODO handle curry with Inst instead of Any?
   std::vector<std::pair<Inst, Slice>> currys;
 
+  // Native and script fn names, only used for diagnostics
+  Map<Inst, std::string> names;
+
+  // Most inputs any graph here or in the base takes, tail call argument buffers are reserved to it
+  i32 max_arity = 0;
+
+  Program() = default;
+  explicit Program(std::shared_ptr<const Program>);
+
+  // Program holding an inst, which is then indexed by index(inst)
+  const Program& owner(Inst i) const {
+    const Program* p = this;
+    while(i.get() < p->offset) {
+      p = p->base.get();
+    }
+    return *p;
+  }
+
+  i32 index(Inst i) const { return i.get() - offset; }
+
+  int depth() const { return base ? base->depth() + 1 : 0; }
+
   Inst add(Any);
-  Inst add(AnyFn, int output_count);
+  Inst add(AnyFn, int output_count, Cost = Cost::Unknown, Purity = Purity::Unknown, bool async = false);
   Inst add(FunctionGraph);
   Inst add(FunctionalInst, int output_count);
   Inst add(IfInst, int output_count);
@@ -63,4 +173,13 @@ struct Program {
   }
 };
 
+// Whether running an inst can do anything besides producing its outputs, calls through fn values are assumed to
+bool has_side_effects(const Program&, Inst);
+
+// Outputs of a fn called on value insts, nullopt if it throws or they can't be copied
+std::optional<std::vector<Any>> evaluate(const Program&, Inst fn, Span<Inst> values, Span<Inst> borrows);
+
+// Copies every layer into a single program without a base
+Program flatten(const Program&);
+
 } // namespace ooze
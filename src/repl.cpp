@@ -3,6 +3,7 @@
 #include "bindings.h"
 #include "io.h"
 #include "parser_combinators.h"
+#include "profiler.h"
 #include "repl.h"
 #include "src_map.h"
 
@@ -10,6 +11,7 @@
 
 #include <CLI/CLI.hpp>
 
+#include <filesystem>
 #include <thread>
 
 namespace ooze {
@@ -24,32 +26,50 @@ struct CLIState {
 
   std::vector<std::string> scripts;
   std::vector<std::string> run_args;
+  std::string profile_file;
+  std::string cache_file;
 
   int num_threads = int(std::thread::hardware_concurrency());
 
   CLIState() : app{"", "ooze"} {
     app.add_option("-t,--threads", num_threads, "Number of threads (0 for seq)")
       ->check(CLI::Range(0, int(std::thread::hardware_concurrency())));
+    app.add_option("--cache", cache_file, "compiled scripts, reused until the scripts change");
 
     run_cmd = app.add_subcommand("run", "");
     run_cmd->add_option("script", scripts, "")->required()->expected(1, -1);
     run_cmd->add_option("--args", run_args, "arguments to main()");
+    run_cmd->add_option("--profile", profile_file, "write a chrome trace (and collapsed stacks alongside it)");
 
     repl_cmd = app.add_subcommand("repl", "");
     repl_cmd->add_option("script", scripts, "");
   }
 };
 
-StringResult<void, Env> parse_scripts(Env e, const std::vector<std::string>& filenames) {
+StringResult<void, Env> parse_scripts(Env e, const std::vector<std::string>& filenames, const std::string& cache) {
   std::vector<StringResult<std::string>> srcs = transform_to_vec(filenames, read_text_file);
 
   std::vector<std::string> errors = knot::accumulate(srcs, std::vector<std::string>{}, [](auto acc, const auto& r) {
     return r ? std::move(acc) : to_vec(std::move(r.error()), std::move(acc));
   });
 
-  return errors.empty() ? std::move(e).parse_scripts(
-                            transform_to_vec(srcs, [](const auto& r) { return std::string_view{r.value()}; }))
-                        : StringResult<void, Env>{Failure{std::move(errors)}, std::move(e)};
+  if(!errors.empty()) {
+    return StringResult<void, Env>{Failure{std::move(errors)}, std::move(e)};
+  }
+
+  const auto files = transform_to_vec(srcs, [](const auto& r) { return std::string_view{r.value()}; });
+
+  if(cache.empty()) {
+    return std::move(e).parse_scripts(files);
+  } else if(read_binary_file(cache).and_then([&](auto bytes) { return e.deserialize_scripts(bytes, files); })) {
+    return std::move(e);
+  }
+
+  // A stale or missing cache is simply rebuilt, failing to write it only costs the next startup
+  return std::move(e).parse_scripts(files).map_state([&](Env e) {
+    e.serialize_scripts(files).and_then([&](auto bytes) { return write_binary_file(cache, bytes); });
+    return e;
+  });
 }
 
 struct HelpCmd {};
@@ -62,6 +82,7 @@ struct TypesCmd {};
 struct DropCmd {
   std::string var;
 };
+struct ReactiveCmd {};
 
 auto help_parser() { return pc::construct<HelpCmd>(pc::constant("h", "h")); }
 
@@ -75,8 +96,16 @@ auto types_parser() { return pc::construct<TypesCmd>(pc::constant("t", "t")); }
 
 auto drop_parser() { return pc::construct<DropCmd>(pc::seq(pc::constant("d", "d"), pc::any())); }
 
+auto reactive_parser() { return pc::construct<ReactiveCmd>(pc::constant("r", "r")); }
+
 auto cmd_parser() {
-  return pc::choose(help_parser(), eval_parser(), bindings_parser(), functions_parser(), types_parser(), drop_parser());
+  return pc::choose(help_parser(),
+                    eval_parser(),
+                    bindings_parser(),
+                    functions_parser(),
+                    types_parser(),
+                    drop_parser(),
+                    reactive_parser());
 }
 
 auto parse_command(std::string_view line) {
@@ -100,7 +129,8 @@ std::tuple<std::vector<std::string>, Env> run(Executor&, Env env, const HelpCmd&
                              {":b - List all bindings (* means they are not ready, & means they are borrowed)"},
                              {":f - List all native and script functions"},
                              {":t - List all registered types and their capabilities"},
-                             {":d binding - Drop the given binding"}},
+                             {":d binding - Drop the given binding"},
+                             {":r - Toggle recomputing the bindings assigned from a binding when it's reassigned"}},
     std::move(env));
 }
 
@@ -184,6 +214,11 @@ std::tuple<std::vector<std::string>, Env> run(Executor&, Env env, const DropCmd&
                            : std::tuple(make_vector(fmt::format("Binding {} not found", cmd.var)), std::move(env));
 }
 
+std::tuple<std::vector<std::string>, Env> run(Executor&, Env env, const ReactiveCmd&) {
+  env.set_reactive(!env.reactive());
+  return {make_vector(fmt::format("Reactive mode {}", env.reactive() ? "on" : "off")), std::move(env)};
+}
+
 } // namespace
 
 std::tuple<Future, Env> step_repl(Executor& executor, Env env, std::string_view line) {
@@ -247,7 +282,7 @@ int repl_main(int argc, const char** argv, Env env) {
     return cli.app.exit(e);
   }
 
-  auto result = parse_scripts(std::move(env), cli.scripts);
+  auto result = parse_scripts(std::move(env), cli.scripts, cli.cache_file);
 
   if(!result) {
     for(const std::string& line : result.error()) {
@@ -260,6 +295,11 @@ int repl_main(int argc, const char** argv, Env env) {
 
   int ret = 0;
 
+  Profiler profiler;
+  if(!cli.profile_file.empty()) {
+    set_active_profiler(&profiler);
+  }
+
   {
     Executor executor = cli.num_threads == 0 ? make_seq_executor() : make_tbb_executor(cli.num_threads);
 
@@ -298,6 +338,23 @@ int repl_main(int argc, const char** argv, Env env) {
     }
   } // Executor goes out of scope
 
+  if(!cli.profile_file.empty()) {
+    set_active_profiler(nullptr);
+
+    const std::string stacks_file = std::filesystem::path(cli.profile_file).replace_extension("folded").string();
+
+    const auto result = write_text_file(cli.profile_file, chrome_trace(profiler)).and_then([&]() {
+      return write_text_file(stacks_file, collapsed_stacks(profiler));
+    });
+
+    if(!result) {
+      for(const std::string& line : result.error()) {
+        fmt::print("{}\n", line);
+      }
+      ret = 1;
+    }
+  }
+
   return ret;
 }
 
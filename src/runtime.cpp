@@ -2,14 +2,28 @@
 
 #include "runtime.h"
 
+#include "constructing_graph.h"
+#include "profiler.h"
+
 #include "ooze/borrowed_future.h"
 #include "ooze/executor.h"
 #include "ooze/future.h"
+#include "ooze/parallel.h"
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
 
 #include <algorithm>
 #include <array>
 #include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <vector>
 
@@ -17,41 +31,22 @@ namespace ooze {
 
 namespace {
 
-template <typename T, std::size_t N>
-class SSOBuffer : public std::span<T> {
-  std::variant<std::unique_ptr<T[]>, std::array<T, N>> _data;
-
-public:
-  SSOBuffer() = default;
-  explicit SSOBuffer(size_t count) {
-    if(count < N) {
-      _data = std::array<T, N>{};
-      static_cast<std::span<T>&>(*this) = std::span(std::get<1>(_data).data(), count);
-    } else {
-      _data = std::make_unique<T[]>(count);
-      static_cast<std::span<T>&>(*this) = std::span(std::get<0>(_data).get(), count);
-    }
-  }
-
-  SSOBuffer(const SSOBuffer&) = delete;
-  SSOBuffer& operator=(const SSOBuffer&) = delete;
-
-  SSOBuffer(SSOBuffer&&) = delete;
-  SSOBuffer& operator=(SSOBuffer&&) = delete;
-};
-
 struct TailCall {
   Inst inst;
   std::vector<Any> inputs;
   std::vector<const Any*> borrowed_inputs;
 };
 
+// Invoked once an instruction has written all of its outputs
+using NodeContinuation = std::function<void()>;
+
+// Invoked once every node of a graph has finished, with whether it wrote a tail call to execute next
+using GraphContinuation = std::function<void(bool)>;
+
 struct InvocationBlock {
   std::shared_ptr<const Program> p;
   Inst inst;
 
-  bool parallel = false;
-
   std::atomic<int> ref_count;
 
   std::vector<Any> any_buffer; // [inputs + outputs]
@@ -59,69 +54,356 @@ struct InvocationBlock {
   std::vector<BorrowedFuture> borrowed_futures;
 
   std::vector<Promise> promises;
+  NodeContinuation finished;
 };
 
 void execute(const Program&,
-             bool parallel,
+             Executor&,
              Inst,
              std::span<Any> inputs,
              std::span<const Any*> borrowed_inputs,
-             std::span<Any> outputs);
-
-struct ExecutionCtx {
-  std::vector<std::vector<Any>> inputs;
-  std::vector<std::vector<const Any*>> borrowed_inputs;
-  std::vector<std::atomic<int>> ref_counts;
-  std::vector<std::pair<std::atomic<int>, Any>> borrow_cleanups;
-  std::optional<tbb::task_group> tg;
+             std::span<Any> outputs,
+             ProfileID parent,
+             NodeContinuation);
+
+// Program and executor running the native on this thread, so it can call the fn values it's passed
+struct NativeContext {
+  const Program* p = nullptr;
+  Executor* ex = nullptr;
+};
+
+thread_local NativeContext native_context;
+
+// Installs a native context for its lifetime, restoring the caller's even if the native throws
+class NativeContextGuard {
+  NativeContext _caller;
+
+public:
+  explicit NativeContextGuard(NativeContext ctx) : _caller(std::exchange(native_context, ctx)) {}
+  ~NativeContextGuard() { native_context = _caller; }
+
+  NativeContextGuard(const NativeContextGuard&) = delete;
+  NativeContextGuard& operator=(const NativeContextGuard&) = delete;
+};
+
+// Recycles invocation frames through per thread free lists bucketed by power of two size
+class FramePool {
+  static constexpr size_t MaxCached = 64;
+
+  std::array<std::vector<void*>, 64> _free;
+
+public:
+  FramePool() = default;
+  ~FramePool() {
+    for(const std::vector<void*>& bucket : _free) {
+      for(void* frame : bucket) {
+        ::operator delete(frame);
+      }
+    }
+  }
+
+  FramePool(const FramePool&) = delete;
+  FramePool& operator=(const FramePool&) = delete;
+
+  void* allocate(size_t bytes) {
+    const int bucket = std::bit_width(bytes - 1);
+    if(std::vector<void*>& free = _free[bucket]; !free.empty()) {
+      void* frame = free.back();
+      free.pop_back();
+      return frame;
+    }
+    return ::operator new(size_t(1) << bucket);
+  }
+
+  // Frames may be released on a different thread than the one they were allocated on
+  void release(void* frame, size_t bytes) {
+    if(std::vector<void*>& free = _free[std::bit_width(bytes - 1)]; free.size() < MaxCached) {
+      free.push_back(frame);
+    } else {
+      ::operator delete(frame);
+    }
+  }
 };
 
-void propagate(ExecutionCtx&, const FunctionGraph&, const Program&, std::span<const ValueForward>, std::span<Any>);
+FramePool& frame_pool() {
+  thread_local FramePool pool;
+  return pool;
+}
+
+// Value and borrow slots of a graph invocation as described by its layout
+struct FrameSlots {
+  const FrameLayout& frame;
+
+  Any* values;
+  const Any** borrows;
+
+  std::span<Any> inputs(int node) const {
+    return {values + frame.input_offsets[node], values + frame.input_offsets[node + 1]};
+  }
+
+  std::span<const Any*> borrowed_inputs(int node) const {
+    return {borrows + frame.borrow_offsets[node], borrows + frame.borrow_offsets[node + 1]};
+  }
+
+  std::span<Any> outputs(int node) const {
+    return {values + frame.output_offsets[node], values + frame.output_offsets[node + 1]};
+  }
+
+  Any& cleanup_value(int cleanup_idx) const { return values[frame.output_offsets.back() + cleanup_idx]; }
+};
+
+// Header of the single allocation backing an invocation of a graph, followed by the slots described by its layout.
+// It outlives the call to execute_graph() and is released by whoever finishes the last node.
+struct ExecutionCtx : FrameSlots {
+  const Program& p;
+  const FunctionGraph& g;
+  Executor& ex;
+
+  std::atomic<int>* counts;
+
+  // Nodes that have yet to finish plus one while the graph is being started
+  std::atomic<int> pending;
+
+  ProfileID profile_id;
 
-void execute_node(ExecutionCtx& ctx, const FunctionGraph& g, const Program& p, int i);
+  std::span<Any> graph_outputs;
+  TailCall* tailcall;
+  GraphContinuation done;
 
-void fwd_owned(ExecutionCtx& ctx, const FunctionGraph& g, const Program& p, Term t, Any a) {
-  ctx.inputs[t.node_id][t.port] = std::move(a);
-  if(decrement(ctx.ref_counts[t.node_id])) {
-    execute_node(ctx, g, p, t.node_id);
+  std::atomic<int>& ref_count(int node) const { return counts[node]; }
+
+  std::atomic<int>& cleanup_count(int cleanup_idx) const {
+    return counts[frame.input_offsets.size() - 1 + cleanup_idx];
   }
+};
+
+// Nodes of a sequential invocation run one at a time in the order of the layout, so they are never counted and
+// borrow cleanups only need plain counts
+struct SeqExecutionCtx : FrameSlots {
+  int* cleanup_counts;
+};
+
+static_assert(sizeof(ExecutionCtx) % alignof(Any) == 0);
+static_assert(alignof(Any) >= alignof(const Any*));
+static_assert(alignof(const Any*) >= alignof(std::atomic<int>));
+
+size_t frame_size(const FrameLayout& frame) {
+  return sizeof(ExecutionCtx) + frame.value_count * sizeof(Any) + frame.borrow_offsets.back() * sizeof(const Any*) +
+         frame.counts.size() * sizeof(std::atomic<int>);
 }
 
-void fwd_borrow(ExecutionCtx& ctx, const FunctionGraph& g, const Program& p, Term t, const Any* a) {
-  ctx.borrowed_inputs[t.node_id][t.port] = a;
-  if(decrement(ctx.ref_counts[t.node_id])) {
-    execute_node(ctx, g, p, t.node_id);
+ExecutionCtx* make_execution_ctx(const Program& p,
+                                 const FunctionGraph& g,
+                                 const FrameLayout& frame,
+                                 Executor& ex,
+                                 ProfileID profile_id,
+                                 std::span<Any> graph_outputs,
+                                 TailCall& tailcall,
+                                 GraphContinuation done) {
+  auto* header = static_cast<std::byte*>(frame_pool().allocate(frame_size(frame)));
+
+  auto* values = reinterpret_cast<Any*>(header + sizeof(ExecutionCtx));
+  auto* borrows = reinterpret_cast<const Any**>(values + frame.value_count);
+  auto* counts = reinterpret_cast<std::atomic<int>*>(borrows + frame.borrow_offsets.back());
+
+  std::uninitialized_default_construct_n(values, frame.value_count);
+  for(size_t i = 0; i < frame.counts.size(); i++) {
+    new(counts + i) std::atomic<int>(frame.counts[i]);
   }
+
+  return new(header) ExecutionCtx{{frame, values, borrows},
+                                  p,
+                                  g,
+                                  ex,
+                                  counts,
+                                  int(g.insts.size()) - (g.tailcall ? 1 : 0) + 1,
+                                  profile_id,
+                                  graph_outputs,
+                                  &tailcall,
+                                  std::move(done)};
 }
 
-void execute_node(ExecutionCtx& ctx, const FunctionGraph& g, const Program& p, int i) {
-  const auto exec = [&ctx, &p, &g, i]() {
-    auto outputs = SSOBuffer<Any, 10>(p.output_counts[g.insts[i].get()]);
-    execute(p, ctx.tg.has_value(), g.insts[i], ctx.inputs[i], ctx.borrowed_inputs[i], outputs);
-    propagate(ctx, g, p, g.owned_fwds[i + 1], outputs);
-    for(int cleanup_idx : g.node_borrows[i]) {
-      if(auto& [rc, any] = ctx.borrow_cleanups[cleanup_idx]; decrement(rc)) {
-        if(const auto fwd = g.borrow_cleanups[cleanup_idx].fwd; fwd) {
-          fwd_owned(ctx, g, p, *fwd, std::move(any));
-        } else {
-          any = {};
-        }
+void release(ExecutionCtx* ctx) {
+  const FrameLayout& frame = ctx->frame;
+  std::destroy_n(ctx->values, frame.value_count);
+  std::destroy_n(ctx->counts, frame.counts.size());
+  ctx->~ExecutionCtx();
+  frame_pool().release(ctx, frame_size(frame));
+}
+
+// Graphs without any values still need a non empty frame for it to map to a pool bucket
+size_t seq_frame_size(const FrameLayout& frame) {
+  return std::max(size_t(1),
+                  frame.value_count * sizeof(Any) + frame.borrow_offsets.back() * sizeof(const Any*) +
+                    (frame.counts.size() - frame.input_offsets.size() + 1) * sizeof(int));
+}
+
+SeqExecutionCtx make_seq_execution_ctx(const FrameLayout& frame) {
+  auto* values = static_cast<Any*>(frame_pool().allocate(seq_frame_size(frame)));
+  auto* borrows = reinterpret_cast<const Any**>(values + frame.value_count);
+  auto* cleanup_counts = reinterpret_cast<int*>(borrows + frame.borrow_offsets.back());
+
+  std::uninitialized_default_construct_n(values, frame.value_count);
+  std::copy(frame.counts.begin() + frame.input_offsets.size() - 1, frame.counts.end(), cleanup_counts);
+
+  return {{frame, values, borrows}, cleanup_counts};
+}
+
+void release(const SeqExecutionCtx& ctx) {
+  std::destroy_n(ctx.values, ctx.frame.value_count);
+  frame_pool().release(ctx.values, seq_frame_size(ctx.frame));
+}
+
+template <typename Ctx>
+void propagate(Ctx&, std::span<const ValueForward>, std::span<Any>);
+
+// Reused by every ReadyNodes on a thread so collecting spawns doesn't allocate once warm
+std::vector<int>& spawn_stack() {
+  thread_local std::vector<int> stack;
+  return stack;
+}
+
+// Nodes made ready while forwarding the values of a node, the ones worth spawning are only spawned once forwarding is
+// done so they can be ordered by how critical they are. They're kept past begin on the thread's spawn stack, any
+// ReadyNodes created while this one is alive pops its own before it's destroyed.
+struct ReadyNodes {
+  ExecutionCtx& ctx;
+  std::vector<int>& spawns;
+  size_t begin;
+
+  explicit ReadyNodes(ExecutionCtx& ctx) : ctx(ctx), spawns(spawn_stack()), begin(spawns.size()) {}
+  ~ReadyNodes() { spawns.resize(begin); }
+
+  ReadyNodes(const ReadyNodes&) = delete;
+  ReadyNodes& operator=(const ReadyNodes&) = delete;
+
+  Any& cleanup_value(int cleanup_idx) const { return ctx.cleanup_value(cleanup_idx); }
+};
+
+void ready(ReadyNodes&, int i);
+
+void fwd_owned(ReadyNodes& r, Term t, Any a) {
+  r.ctx.inputs(t.node_id)[t.port] = std::move(a);
+  if(decrement(r.ctx.ref_count(t.node_id))) {
+    ready(r, t.node_id);
+  }
+}
+
+void fwd_borrow(ReadyNodes& r, Term t, const Any* a) {
+  r.ctx.borrowed_inputs(t.node_id)[t.port] = a;
+  if(decrement(r.ctx.ref_count(t.node_id))) {
+    ready(r, t.node_id);
+  }
+}
+
+void fwd_owned(SeqExecutionCtx& ctx, Term t, Any a) { ctx.inputs(t.node_id)[t.port] = std::move(a); }
+void fwd_borrow(SeqExecutionCtx& ctx, Term t, const Any* a) { ctx.borrowed_inputs(t.node_id)[t.port] = a; }
+
+// Moves out the graph outputs, or the inputs of the tail call if there is one
+// Reuses the capacity of whatever call was in tc before
+void assign(TailCall& tc, Inst inst, std::span<Any> inputs, std::span<const Any*> borrowed_inputs) {
+  tc.inst = inst;
+  tc.inputs.assign(std::make_move_iterator(inputs.begin()), std::make_move_iterator(inputs.end()));
+  tc.borrowed_inputs.assign(borrowed_inputs.begin(), borrowed_inputs.end());
+}
+
+// Writes the tail call into tc if there is one, otherwise moves the graph outputs out
+bool take_results(const FunctionGraph& g, const FrameSlots& slots, std::span<Any> graph_outputs, TailCall& tc) {
+  if(const auto node = g.tailcall; node) {
+    assign(tc, g.insts[*node], slots.inputs(*node), slots.borrowed_inputs(*node));
+    return true;
+  } else {
+    const std::span<Any> outputs = slots.inputs(int(g.insts.size()));
+    std::move(outputs.begin(), outputs.end(), graph_outputs.begin());
+    return false;
+  }
+}
+
+void finish_graph(ExecutionCtx* ctx) {
+  const bool tailcall = take_results(ctx->g, *ctx, ctx->graph_outputs, *ctx->tailcall);
+
+  GraphContinuation done = std::move(ctx->done);
+  release(ctx);
+  done(tailcall);
+}
+
+void spawn(ReadyNodes&);
+
+void finish_node(ExecutionCtx& ctx, int i) {
+  ReadyNodes r{ctx};
+  propagate(r, ctx.g.owned_fwds[i + 1], ctx.outputs(i));
+
+  for(int cleanup_idx : ctx.g.node_borrows[i]) {
+    if(decrement(ctx.cleanup_count(cleanup_idx))) {
+      if(const auto fwd = ctx.g.borrow_cleanups[cleanup_idx].fwd; fwd) {
+        fwd_owned(r, *fwd, std::move(ctx.cleanup_value(cleanup_idx)));
+      } else {
+        ctx.cleanup_value(cleanup_idx) = {};
       }
     }
-  };
+  }
+
+  // Spawned before this node counts as finished so ctx can't be released in the meantime
+  spawn(r);
 
-  if(ctx.tg) {
-    ctx.tg->run(exec);
+  if(decrement(ctx.pending)) {
+    finish_graph(&ctx);
+  }
+}
+
+// Values and cheap fns run inline since spawning a task for them costs more than executing them
+bool worth_spawning(const Program& p, Inst inst) {
+  const Program& owner = p.owner(inst);
+  const i32 idx = owner.index(inst);
+  switch(owner.inst[idx]) {
+  case InstOp::Value: return false;
+  case InstOp::Fn: return owner.fn_costs[owner.inst_data[idx]].spawn();
+  default: return true;
+  }
+}
+
+void execute_node(ExecutionCtx& ctx, int i) {
+  execute(ctx.p,
+          ctx.ex,
+          ctx.g.insts[i],
+          ctx.inputs(i),
+          ctx.borrowed_inputs(i),
+          ctx.outputs(i),
+          ctx.profile_id,
+          [&ctx, i]() { finish_node(ctx, i); });
+}
+
+// Nodes run inline recurse through the node that made them ready, past this depth they're spawned instead so long
+// chains of them unwind the stack
+constexpr int MaxInlineDepth = 64;
+thread_local int inline_depth = 0;
+
+void ready(ReadyNodes& r, int i) {
+  if(inline_depth < MaxInlineDepth && !worth_spawning(r.ctx.p, r.ctx.g.insts[i])) {
+    inline_depth++;
+    execute_node(r.ctx, i);
+    inline_depth--;
   } else {
-    exec();
+    r.spawns.push_back(i);
   }
 }
 
-void propagate(ExecutionCtx& ctx,
-               const FunctionGraph& g,
-               const Program& p,
-               std::span<const ValueForward> fwds,
-               std::span<Any> values) {
+// Least critical first since this thread picks up the task it spawned last next, while idle workers steal the oldest
+void spawn(ReadyNodes& r) {
+  const std::vector<int>& critical_path = r.ctx.frame.critical_path;
+  const size_t end = r.spawns.size();
+  std::sort(r.spawns.begin() + r.begin, r.spawns.end(), [&](int x, int y) {
+    return critical_path[x] < critical_path[y];
+  });
+
+  // Indexed since tasks the executor runs inline push past end and can reallocate the stack
+  for(size_t k = r.begin; k < end; k++) {
+    r.ctx.ex.run([&ctx = r.ctx, i = r.spawns[k]]() { execute_node(ctx, i); });
+  }
+}
+
+template <typename Ctx>
+void propagate(Ctx& ctx, std::span<const ValueForward> fwds, std::span<Any> values) {
   assert(fwds.size() == values.size());
 
   for(int i = 0; i < int(fwds.size()); i++) {
@@ -129,192 +411,474 @@ void propagate(ExecutionCtx& ctx,
 
     // Propagate to all copy dsts
     for(int u = 0; u < fwd.copy_end; u++) {
-      fwd_owned(ctx, g, p, fwd.terms[u], values[i]);
+      fwd_owned(ctx, fwd.terms[u], values[i]);
     }
 
     if(fwd.move_end != fwd.terms.size()) {
       // Move to fixed position then propagate borrows
-      ctx.borrow_cleanups[fwd.cleanup_idx].second = std::move(values[i]);
-      const Any* borrow = &ctx.borrow_cleanups[fwd.cleanup_idx].second;
+      ctx.cleanup_value(fwd.cleanup_idx) = std::move(values[i]);
+      const Any* borrow = &ctx.cleanup_value(fwd.cleanup_idx);
       for(int u = fwd.move_end; u < std::ssize(fwds[i].terms); u++) {
-        fwd_borrow(ctx, g, p, fwd.terms[u], borrow);
+        fwd_borrow(ctx, fwd.terms[u], borrow);
       }
     } else if(fwd.copy_end != fwd.move_end) {
       // Propagate move if not being borrowed
-      fwd_owned(ctx, g, p, fwd.terms[fwd.copy_end], std::move(values[i]));
+      fwd_owned(ctx, fwd.terms[fwd.copy_end], std::move(values[i]));
     }
   }
 }
 
-void propagate(ExecutionCtx& ctx,
-               const FunctionGraph& g,
-               const Program& p,
-               std::span<const ValueForward> fwds,
-               std::span<const Any*> borrows) {
+template <typename Ctx>
+void propagate(Ctx& ctx, std::span<const ValueForward> fwds, std::span<const Any*> borrows) {
   assert(fwds.size() == borrows.size());
   for(int i = 0; i < std::ssize(fwds); i++) {
     assert(fwds[i].copy_end == fwds[i].move_end);
 
     for(int u = 0; u < fwds[i].copy_end; u++) {
-      fwd_owned(ctx, g, p, fwds[i].terms[u], *borrows[i]);
+      fwd_owned(ctx, fwds[i].terms[u], *borrows[i]);
     }
 
     for(int u = fwds[i].copy_end; u < int(fwds[i].terms.size()); u++) {
-      fwd_borrow(ctx, g, p, fwds[i].terms[u], borrows[i]);
+      fwd_borrow(ctx, fwds[i].terms[u], borrows[i]);
     }
   }
 }
 
-std::optional<TailCall>
-execute_graph(const FunctionGraph& g,
-              const Program& p,
-              bool parallel,
-              std::span<Any> inputs,
-              std::span<const Any*> borrowed_inputs,
-              std::span<Any> outputs) {
-  ExecutionCtx ctx = {
-    std::vector<std::vector<Any>>(g.input_counts.size() + (g.tailcall ? 0 : 1)),
-    std::vector<std::vector<const Any*>>(g.input_counts.size()),
-    std::vector<std::atomic<int>>(g.input_counts.size() + (g.tailcall ? 0 : 1)),
-    std::vector<std::pair<std::atomic<int>, Any>>(g.borrow_cleanups.size()),
-  };
-
-  if(parallel) {
-    ctx.tg.emplace(); // tbb::task_group is not copyable or moveable
-  }
-
-  // Initialize inputs
-  for(int i = 0; i < std::ssize(g.input_counts); i++) {
-    const auto [owned, borrowed] = g.input_counts[i];
-    ctx.ref_counts[i] = owned + borrowed;
-    ctx.inputs[i] = std::vector<Any>(owned);
-    ctx.borrowed_inputs[i] = std::vector<const Any*>(borrowed);
-  }
-
-  for(int i = 0; i < std::ssize(g.borrow_cleanups); i++) {
-    ctx.borrow_cleanups[i].first = g.borrow_cleanups[i].count;
-  }
-
-  if(g.tailcall) {
-    // Ensure tailcall never executes
-    ctx.ref_counts[*g.tailcall]++;
-  } else {
-    // Ensure output never executes
-    ctx.ref_counts.back() = g.output_count + 1;
-    ctx.inputs.back() = std::vector<Any>(g.output_count);
-  }
+// Never blocks, nodes are scheduled on the executor and done is invoked by whichever thread finishes the last one.
+// A tail call is written to tc, which has to outlive the graph.
+void execute_graph(const FunctionGraph& g,
+                   const FrameLayout& frame,
+                   const Program& p,
+                   Executor& ex,
+                   std::span<Any> inputs,
+                   std::span<const Any*> borrowed_inputs,
+                   std::span<Any> outputs,
+                   ProfileID profile_id,
+                   TailCall& tc,
+                   GraphContinuation done) {
+  auto* ctx = make_execution_ctx(p, g, frame, ex, profile_id, outputs, tc, std::move(done));
+  ReadyNodes r{*ctx};
 
   // Start 0 input tasks
   for(int i = 0; i < std::ssize(g.input_counts); i++) {
     const auto [owned, borrowed] = g.input_counts[i];
     if(owned + borrowed == 0 && g.tailcall != i) {
-      execute_node(ctx, g, p, i);
+      ready(r, i);
     }
   }
 
-  propagate(ctx, g, p, g.owned_fwds.front(), inputs);
-  propagate(ctx, g, p, g.input_borrowed_fwds, borrowed_inputs);
+  propagate(r, g.owned_fwds.front(), inputs);
+  propagate(r, g.input_borrowed_fwds, borrowed_inputs);
+
+  spawn(r);
 
-  if(ctx.tg) {
-    ctx.tg->wait();
+  if(decrement(ctx->pending)) {
+    finish_graph(ctx);
   }
+}
 
-  if(g.tailcall) {
-    return TailCall{
-      g.insts[*g.tailcall], std::move(ctx.inputs[*g.tailcall]), std::move(ctx.borrowed_inputs[*g.tailcall])};
-  } else {
-    std::move(ctx.inputs.back().begin(), ctx.inputs.back().end(), outputs.begin());
-    return std::nullopt;
+// Runs every node to completion from the precomputed order of the layout instead of recursing through each
+// forwarded value, so the stack doesn't grow with the length of dependency chains. Returns whether tc was written.
+bool execute_graph_seq(const FunctionGraph& g,
+                       const FrameLayout& frame,
+                       const Program& p,
+                       Executor& ex,
+                       std::span<Any> inputs,
+                       std::span<const Any*> borrowed_inputs,
+                       std::span<Any> outputs,
+                       ProfileID profile_id,
+                       TailCall& tc) {
+  SeqExecutionCtx ctx = make_seq_execution_ctx(frame);
+
+  propagate(ctx, g.owned_fwds.front(), inputs);
+  propagate(ctx, g.input_borrowed_fwds, borrowed_inputs);
+
+  for(const int i : frame.order) {
+    bool finished = false;
+    execute(p,
+            ex,
+            g.insts[i],
+            ctx.inputs(i),
+            ctx.borrowed_inputs(i),
+            ctx.outputs(i),
+            profile_id,
+            [&finished]() { finished = true; });
+    assert(finished);
+
+    propagate(ctx, g.owned_fwds[i + 1], ctx.outputs(i));
+
+    for(int cleanup_idx : g.node_borrows[i]) {
+      if(--ctx.cleanup_counts[cleanup_idx] == 0) {
+        if(const auto fwd = g.borrow_cleanups[cleanup_idx].fwd; fwd) {
+          fwd_owned(ctx, *fwd, std::move(ctx.cleanup_value(cleanup_idx)));
+        } else {
+          ctx.cleanup_value(cleanup_idx) = {};
+        }
+      }
+    }
   }
+
+  const bool tailcall = take_results(g, ctx, outputs, tc);
+  release(ctx);
+  return tailcall;
 }
 
-TailCall execute_if(const IfInst& inst, std::span<Any> inputs, std::span<const Any*> borrowed_inputs) {
+void execute_if(const IfInst& inst, std::span<Any> inputs, std::span<const Any*> borrowed_inputs, TailCall& tc) {
   assert(holds_alternative<bool>(inputs[0]));
   const bool cond = any_cast<bool>(inputs[0]);
   inputs = inputs.subspan(1);
 
   if(cond) {
-    return TailCall{inst.if_inst,
-                    std::vector<Any>(std::make_move_iterator(inputs.begin()),
-                                     std::make_move_iterator(inputs.begin() + inst.value_offsets[1])),
-                    std::vector<const Any*>(borrowed_inputs.begin(), borrowed_inputs.begin() + inst.borrow_offsets[1])};
+    assign(tc,
+           inst.if_inst,
+           inputs.subspan(0, inst.value_offsets[1]),
+           borrowed_inputs.subspan(0, inst.borrow_offsets[1]));
   } else {
-    const auto input_it =
-      std::move(inputs.begin() + inst.value_offsets[1], inputs.end(), inputs.begin() + inst.value_offsets[0]);
+    assign(tc,
+           inst.else_inst,
+           inputs.subspan(0, inst.value_offsets[0]),
+           borrowed_inputs.subspan(0, inst.borrow_offsets[0]));
+    tc.inputs.insert(tc.inputs.end(),
+                     std::make_move_iterator(inputs.begin() + inst.value_offsets[1]),
+                     std::make_move_iterator(inputs.end()));
+    tc.borrowed_inputs.insert(
+      tc.borrowed_inputs.end(), borrowed_inputs.begin() + inst.borrow_offsets[1], borrowed_inputs.end());
+  }
+}
 
-    const auto borrow_it =
-      std::move(borrowed_inputs.begin() + inst.borrow_offsets[1],
-                borrowed_inputs.end(),
-                borrowed_inputs.begin() + inst.borrow_offsets[0]);
+void execute_curry(const std::pair<Inst, Slice>& curry,
+                   const Program& p,
+                   std::span<Any> inputs,
+                   std::span<const Any*> borrowed_inputs,
+                   TailCall& tc) {
+  const auto [curry_inst, slice] = curry;
 
-    return TailCall{inst.else_inst,
-                    std::vector<Any>(std::make_move_iterator(inputs.begin()), std::make_move_iterator(input_it)),
-                    std::vector<const Any*>(borrowed_inputs.begin(), borrow_it)};
+  assign(tc, curry_inst, inputs, borrowed_inputs);
+
+  // Graphs that never move a curried value borrow it from the program instead of copying it
+  const Program& owner = p.owner(curry_inst);
+  const i32 idx = owner.index(curry_inst);
+  const std::vector<bool>* input_borrows =
+    owner.inst[idx] == InstOp::Graph ? &owner.graphs[owner.inst_data[idx]].input_borrows : nullptr;
+
+  for(i32 i = slice.begin; i < slice.end; i++) {
+    if(input_borrows && (*input_borrows)[input_borrows->size() - size(slice) + (i - slice.begin)]) {
+      tc.borrowed_inputs.push_back(&p.values[i]);
+    } else {
+      tc.inputs.push_back(p.values[i]);
+    }
   }
 }
 
-TailCall execute_curry(
-  const std::pair<Inst, Slice>& curry, const Program& p, std::span<Any> inputs, std::span<const Any*> borrowed_inputs) {
-  const auto [curry_inst, slice] = curry;
+// Argument buffers a chain of tail calls alternates between, each call is written to the buffer the one before it
+// isn't reading from. They're taken from a per thread pool on the first tail call and reserved to the largest arity
+// in the program, so loops of tail calls don't allocate.
+class TailCallBuffers {
+  static constexpr size_t MaxCached = 16;
+
+  const Program& _p;
+  std::optional<std::array<TailCall, 2>> _calls;
+  int _front = 0;
+
+  static std::vector<std::array<TailCall, 2>>& pool() {
+    thread_local std::vector<std::array<TailCall, 2>> pool;
+    return pool;
+  }
+
+public:
+  explicit TailCallBuffers(const Program& p) : _p(p) {}
+  ~TailCallBuffers() {
+    if(_calls && pool().size() < MaxCached) {
+      for(TailCall& tc : *_calls) {
+        tc.inputs.clear();
+        tc.borrowed_inputs.clear();
+      }
+      pool().push_back(std::move(*_calls));
+    }
+  }
+
+  TailCallBuffers(const TailCallBuffers&) = delete;
+  TailCallBuffers& operator=(const TailCallBuffers&) = delete;
+
+  TailCall& next() {
+    if(!_calls) {
+      if(pool().empty()) {
+        _calls.emplace();
+      } else {
+        _calls = std::move(pool().back());
+        pool().pop_back();
+      }
+
+      for(TailCall& tc : *_calls) {
+        tc.inputs.reserve(_p.max_arity);
+        tc.borrowed_inputs.reserve(_p.max_arity);
+      }
+    }
+    return (*_calls)[1 - _front];
+  }
+
+  // Makes the call last written by next() the current one
+  TailCall& advance() {
+    _front = 1 - _front;
+    return (*_calls)[_front];
+  }
+};
+
+// Async fns output a Future of their result, which replaces it once ready. Dependents are resumed on the executor
+// instead of whichever thread fulfills it, sequential executors just block.
+void finish_async(Executor& ex, Any& output, NodeContinuation done) {
+  Future future = std::move(any_cast<Future>(output));
+
+  if(!ex.parallel()) {
+    std::promise<Any> promise;
+    std::future<Any> result = promise.get_future();
+    std::move(future).then([&](Any value) { promise.set_value(std::move(value)); });
+    output = result.get();
+    return done();
+  }
+
+  std::move(future).then([&output, resume = ex.defer(std::move(done))](Any value) {
+    output = std::move(value);
+    resume();
+  });
+}
+
+// A tail call loop suspended on a graph, resumed by whoever finishes the graph or starts it (whichever is last).
+// The graph writes its tail call straight into the record, which is recycled through a per thread pool along with
+// the capacity of its buffers so iterations of the loop don't allocate.
+struct TailCallLoop {
+  const Program* p;
+  Executor* ex;
+  std::span<Any> outputs;
+  ProfileID parent;
+  NodeContinuation done;
+  Profiler* profiler;
+  std::optional<ProfileEvent> event;
+  TailCall tailcall;
+  bool has_tailcall = false;
+  std::atomic<bool> resumable = false;
+};
 
-  std::vector<Any> curried_inputs;
-  curried_inputs.reserve(inputs.size() + size(slice));
+class TailCallLoopPool {
+  static constexpr size_t MaxCached = 64;
 
-  std::move(inputs.begin(), inputs.end(), std::back_inserter(curried_inputs));
-  std::copy(p.values.begin() + slice.begin, p.values.begin() + slice.end, std::back_inserter(curried_inputs));
+  std::vector<std::unique_ptr<TailCallLoop>> _free;
 
-  return TailCall{
-    curry_inst, std::move(curried_inputs), std::vector<const Any*>(borrowed_inputs.begin(), borrowed_inputs.end())};
+public:
+  std::unique_ptr<TailCallLoop> acquire(const Program& p) {
+    std::unique_ptr<TailCallLoop> loop;
+    if(_free.empty()) {
+      loop = std::make_unique<TailCallLoop>();
+    } else {
+      loop = std::move(_free.back());
+      _free.pop_back();
+    }
+
+    loop->tailcall.inputs.reserve(p.max_arity);
+    loop->tailcall.borrowed_inputs.reserve(p.max_arity);
+    loop->resumable.store(false, std::memory_order_relaxed);
+    return loop;
+  }
+
+  // Loops may be released on a different thread than the one they were acquired on
+  void release(std::unique_ptr<TailCallLoop> loop) {
+    if(_free.size() < MaxCached) {
+      loop->done = {};
+      loop->event.reset();
+      loop->tailcall.inputs.clear();
+      loop->tailcall.borrowed_inputs.clear();
+      _free.push_back(std::move(loop));
+    }
+  }
+};
+
+TailCallLoopPool& tail_call_loop_pool() {
+  thread_local TailCallLoopPool pool;
+  return pool;
 }
 
-// TODO expose synchronous api?
-std::optional<TailCall> execute_tailcall(
-  const Program& p,
-  bool parallel,
-  Inst inst,
-  std::span<Any> inputs,
-  std::span<const Any*> borrowed_inputs,
-  std::span<Any> outputs) {
-  assert(outputs.size() == p.output_counts[inst.get()]);
+void resume(TailCallLoop* loop) {
+  NodeContinuation done = std::move(loop->done);
 
-  switch(p.inst[inst.get()]) {
-  case InstOp::Value: outputs[0] = p.values[p.inst_data[inst.get()]]; return std::nullopt;
-  case InstOp::Fn: p.fns[p.inst_data[inst.get()]](inputs, borrowed_inputs, outputs.data()); return std::nullopt;
-  case InstOp::Graph:
-    return execute_graph(p.graphs[p.inst_data[inst.get()]], p, parallel, inputs, borrowed_inputs, outputs);
-  case InstOp::Functional:
-    return execute_tailcall(p, parallel, any_cast<Inst>(inputs[0]), inputs.subspan(1), borrowed_inputs, outputs);
-  case InstOp::If: return execute_if(p.ifs[p.inst_data[inst.get()]], inputs, borrowed_inputs);
-  case InstOp::Curry: return execute_curry(p.currys[p.inst_data[inst.get()]], p, inputs, borrowed_inputs);
-  case InstOp::Placeholder: assert(false); return std::nullopt;
+  // The tail call only reads its inputs before returning or suspending on a graph of its own
+  if(loop->has_tailcall) {
+    TailCall& tc = loop->tailcall;
+    execute(*loop->p, *loop->ex, tc.inst, tc.inputs, tc.borrowed_inputs, loop->outputs, loop->parent, std::move(done));
+  } else {
+    done();
   }
 
-  assert(false);
-  return std::nullopt;
+  tail_call_loop_pool().release(std::unique_ptr<TailCallLoop>(loop));
 }
 
 void execute(const Program& p,
-             bool parallel,
+             Executor& ex,
              Inst inst,
              std::span<Any> inputs,
              std::span<const Any*> borrowed_inputs,
-             std::span<Any> outputs) {
+             std::span<Any> outputs,
+             ProfileID parent,
+             NodeContinuation done) {
+  TailCallBuffers buffers(p);
+  Profiler* const profiler = active_profiler();
+
+  const auto jump = [&]() {
+    TailCall& tc = buffers.advance();
+    inst = tc.inst;
+    inputs = tc.inputs;
+    borrowed_inputs = tc.borrowed_inputs;
+  };
+
+  while(true) {
+    const Program& q = p.owner(inst);
+    const i32 idx = q.index(inst);
+
+    assert(outputs.size() == q.output_counts[idx]);
+
+    // Graphs get an id so the dispatches of their nodes can refer to them
+    std::optional<ProfileEvent> event;
+    if(profiler) {
+      event = ProfileEvent{q.inst[idx] == InstOp::Graph ? profiler->next_id() : 0,
+                           parent,
+                           &q,
+                           inst,
+                           profiler->thread(),
+                           std::chrono::steady_clock::now()};
+    }
+
+    const auto record = [&]() {
+      if(event) {
+        event->end = std::chrono::steady_clock::now();
+        profiler->record(*event);
+      }
+    };
+
+    switch(q.inst[idx]) {
+    case InstOp::Value:
+      outputs[0] = q.values[q.inst_data[idx]];
+      record();
+      return done();
+    case InstOp::Fn: {
+      const i32 fn = q.inst_data[idx];
+      {
+        const NativeContextGuard guard(NativeContext{&p, &ex});
+        if(const FnCost& cost = q.fn_costs[fn]; ex.parallel() && cost.measuring()) {
+          const auto start = std::chrono::steady_clock::now();
+          q.fns[fn](inputs, borrowed_inputs, outputs.data());
+          cost.record(std::chrono::steady_clock::now() - start);
+        } else {
+          q.fns[fn](inputs, borrowed_inputs, outputs.data());
+        }
+      }
+      record();
+
+      if(q.fn_asyncs[fn]) {
+        return finish_async(ex, outputs[0], std::move(done));
+      }
 
-  std::optional<TailCall> tailcall = execute_tailcall(p, parallel, inst, inputs, borrowed_inputs, outputs);
+      return done();
+    }
+    case InstOp::Graph: {
+      if(!ex.parallel()) {
+        const bool tailcall = execute_graph_seq(q.graphs[q.inst_data[idx]],
+                                                q.frames[q.inst_data[idx]],
+                                                q,
+                                                ex,
+                                                inputs,
+                                                borrowed_inputs,
+                                                outputs,
+                                                event ? event->id : 0,
+                                                buffers.next());
+        record();
+
+        if(!tailcall) {
+          return done();
+        }
+
+        jump();
+        break;
+      }
 
-  while(tailcall) {
-    tailcall = execute_tailcall(p, parallel, tailcall->inst, tailcall->inputs, tailcall->borrowed_inputs, outputs);
+      std::unique_ptr<TailCallLoop> owned_loop = tail_call_loop_pool().acquire(p);
+      TailCallLoop* loop = owned_loop.get();
+      loop->p = &p;
+      loop->ex = &ex;
+      loop->outputs = outputs;
+      loop->parent = parent;
+      loop->done = std::move(done);
+      loop->profiler = profiler;
+      loop->event = event;
+
+      execute_graph(q.graphs[q.inst_data[idx]],
+                    q.frames[q.inst_data[idx]],
+                    q,
+                    ex,
+                    inputs,
+                    borrowed_inputs,
+                    outputs,
+                    event ? event->id : 0,
+                    loop->tailcall,
+                    [loop](bool tailcall) {
+                      if(loop->event) {
+                        loop->event->end = std::chrono::steady_clock::now();
+                        loop->profiler->record(*loop->event);
+                      }
+
+                      loop->has_tailcall = tailcall;
+                      if(loop->resumable.exchange(true, std::memory_order_acq_rel)) {
+                        resume(loop);
+                      }
+                    });
+
+      if(!loop->resumable.exchange(true, std::memory_order_acq_rel)) {
+        owned_loop.release();
+        return;
+      }
+
+      // The graph finished synchronously, keep looping here instead of growing the stack. Swapping the tail call
+      // into the buffers hands the loop record their capacity in exchange.
+      done = std::move(loop->done);
+      const bool tailcall = loop->has_tailcall;
+      if(tailcall) {
+        std::swap(buffers.next(), loop->tailcall);
+      }
+      tail_call_loop_pool().release(std::move(owned_loop));
+
+      if(!tailcall) {
+        return done();
+      }
+
+      jump();
+      break;
+    }
+    case InstOp::Functional:
+      inst = any_cast<Inst>(inputs[0]);
+      inputs = inputs.subspan(1);
+      record();
+      break;
+    case InstOp::If:
+      execute_if(q.ifs[q.inst_data[idx]], inputs, borrowed_inputs, buffers.next());
+      jump();
+      record();
+      break;
+    case InstOp::Curry:
+      execute_curry(q.currys[q.inst_data[idx]], q, inputs, borrowed_inputs, buffers.next());
+      jump();
+      record();
+      break;
+    case InstOp::Placeholder: assert(false); return done();
+    }
   }
 }
 
-} // namespace
-
-void execute(std::shared_ptr<const Program> p,
-             Inst inst,
-             Executor& ex,
-             std::vector<Future> inputs,
-             std::vector<BorrowedFuture> borrowed_inputs,
-             std::span<Future> outputs) {
+// finished is invoked once the outputs have been sent, even if there are none
+void execute_invocation(std::shared_ptr<const Program> p,
+                        Inst inst,
+                        Executor& ex,
+                        std::vector<Future> inputs,
+                        std::vector<BorrowedFuture> borrowed_inputs,
+                        std::span<Future> outputs,
+                        NodeContinuation finished) {
 
   std::vector<Promise> promises(outputs.size());
   for(int i = 0; i < std::ssize(outputs); i++) {
@@ -323,35 +887,44 @@ void execute(std::shared_ptr<const Program> p,
 
   const auto total_inputs = inputs.size() + borrowed_inputs.size();
 
+  if(Profiler* profiler = active_profiler(); profiler) {
+    profiler->retain(p);
+  }
+
   auto* b = new InvocationBlock{
     std::move(p),
     inst,
-    ex.parallel(),
     int(total_inputs),
     std::vector<Any>(inputs.size() + outputs.size()),
     std::vector<const Any*>(borrowed_inputs.size()),
     std::move(borrowed_inputs),
-    std::move(promises)};
+    std::move(promises),
+    std::move(finished)};
 
   const auto invoke = [](Executor& ex, InvocationBlock* b) {
-    ex.run([b]() {
+    ex.run([&ex, b]() {
       const size_t output_count = b->promises.size();
       const size_t owned_count = b->any_buffer.size() - output_count;
 
       auto owned_inputs = std::span(b->any_buffer.begin(), owned_count);
       auto outputs = std::span(b->any_buffer.begin() + owned_count, output_count);
 
-      execute(*b->p, b->parallel, b->inst, owned_inputs, b->borrowed_inputs, outputs);
+      execute(*b->p, ex, b->inst, owned_inputs, b->borrowed_inputs, outputs, 0, [b, outputs]() {
+        // Drop reference to all borrowed futures so they can be forwarded asap
+        b->borrowed_futures.clear();
 
-      // Drop reference to all borrowed futures so they can be forwarded asap
-      b->borrowed_futures.clear();
+        // Forward outputs
+        for(size_t i = 0; i < b->promises.size(); i++) {
+          std::move(b->promises[i]).send(std::move(outputs[i]));
+        }
 
-      // Forward outputs
-      for(size_t i = 0; i < b->promises.size(); i++) {
-        std::move(b->promises[i]).send(std::move(outputs[i]));
-      }
+        NodeContinuation finished = std::move(b->finished);
+        delete b;
 
-      delete b;
+        if(finished) {
+          finished();
+        }
+      });
     });
   };
 
@@ -381,4 +954,187 @@ void execute(std::shared_ptr<const Program> p,
   }
 }
 
+// An invocation of a stream waiting for its outputs
+struct StreamInvocation {
+  std::vector<Any> outputs;
+  int remaining;
+};
+
+struct StreamState {
+  std::shared_ptr<const Program> p;
+  Inst inst;
+  Executor& ex;
+  int window;
+  int output_count;
+  const std::function<std::optional<std::vector<Any>>()>& source;
+  const std::function<void(std::vector<Any>)>& sink;
+
+  std::mutex mutex;
+  // In the order their inputs were pulled, the front is sunk as soon as it finishes
+  std::deque<StreamInvocation> in_flight;
+  bool exhausted = false;
+  bool pumping = false;
+  bool dirty = false;
+};
+
+// Sinks finished invocations in order and refills the window. Only one thread pumps at a time, anyone else arriving
+// leaves it dirty so the pumping thread goes around again. This also stops a seq executor from recursing.
+void pump(StreamState& s) {
+  std::unique_lock lock(s.mutex);
+  if(s.pumping) {
+    s.dirty = true;
+    return;
+  }
+
+  s.pumping = true;
+  while(true) {
+    s.dirty = false;
+
+    while(!s.in_flight.empty() && s.in_flight.front().remaining == 0) {
+      std::vector<Any> outputs = std::move(s.in_flight.front().outputs);
+      s.in_flight.pop_front();
+      lock.unlock();
+      s.sink(std::move(outputs));
+      lock.lock();
+    }
+
+    if(!s.exhausted && int(s.in_flight.size()) < s.window) {
+      lock.unlock();
+      std::optional<std::vector<Any>> inputs = s.source();
+      lock.lock();
+
+      if(!inputs) {
+        s.exhausted = true;
+        continue;
+      }
+
+      // Deque references stay valid as other invocations are pushed and popped. An invocation also waits on itself
+      // finishing, so ones without outputs still count towards the window until they're done.
+      StreamInvocation& invocation = s.in_flight.emplace_back(std::vector<Any>(s.output_count), s.output_count + 1);
+      lock.unlock();
+
+      const auto received = [&s, &invocation](std::optional<std::pair<int, Any>> output) {
+        {
+          const std::lock_guard lock(s.mutex);
+          if(output) {
+            invocation.outputs[output->first] = std::move(output->second);
+          }
+          invocation.remaining--;
+        }
+        pump(s);
+      };
+
+      std::vector<Future> results(s.output_count);
+      execute_invocation(s.p,
+                         s.inst,
+                         s.ex,
+                         transform_to_vec(std::move(*inputs), Construct<Future>{}),
+                         {},
+                         results,
+                         [received]() { received(std::nullopt); });
+
+      for(int i = 0; i < s.output_count; i++) {
+        std::move(results[i]).then([received, i](Any value) { received(std::pair(i, std::move(value))); });
+      }
+
+      lock.lock();
+      continue;
+    }
+
+    if(!s.dirty) {
+      break;
+    }
+  }
+  s.pumping = false;
+}
+
+} // namespace
+
+void execute(std::shared_ptr<const Program> p,
+             Inst inst,
+             Executor& ex,
+             std::vector<Future> inputs,
+             std::vector<BorrowedFuture> borrowed_inputs,
+             std::span<Future> outputs) {
+  execute_invocation(std::move(p), inst, ex, std::move(inputs), std::move(borrowed_inputs), outputs, {});
+}
+
+void execute_lazy(std::shared_ptr<const Program> p,
+                  Inst inst,
+                  Executor& ex,
+                  std::vector<Future> inputs,
+                  std::vector<BorrowedFuture> borrowed_inputs,
+                  std::span<Future> outputs,
+                  const std::vector<bool>& requested) {
+  assert(requested.size() == outputs.size());
+
+  const Program& owner = p->owner(inst);
+  if(owner.inst[owner.index(inst)] != InstOp::Graph || stdr::all_of(requested, Identity{})) {
+    return execute(std::move(p), inst, ex, std::move(inputs), std::move(borrowed_inputs), outputs);
+  }
+
+  // The pruned graph only lives as long as this invocation, in a layer on top of the program
+  auto lazy = std::make_shared<Program>(p);
+  const Inst pruned = lazy->add(prune(
+    owner.graphs[owner.inst_data[owner.index(inst)]], requested, [&](Inst i) { return has_side_effects(*p, i); }));
+
+  std::vector<Future> results(stdr::count(requested, true));
+  execute(std::move(lazy), pruned, ex, std::move(inputs), std::move(borrowed_inputs), results);
+
+  auto it = results.begin();
+  for(size_t i = 0; i < outputs.size(); i++) {
+    if(requested[i]) {
+      outputs[i] = std::move(*it++);
+    }
+  }
+}
+
+void execute_stream(std::shared_ptr<const Program> p,
+                    Inst inst,
+                    Executor& ex,
+                    int window,
+                    const std::function<std::optional<std::vector<Any>>()>& source,
+                    const std::function<void(std::vector<Any>)>& sink) {
+  assert(window > 0);
+
+  const Program& owner = p->owner(inst);
+  StreamState s{std::move(p), inst, ex, window, owner.output_counts[owner.index(inst)], source, sink};
+
+  pump(s);
+  ex.wait();
+
+  assert(s.exhausted && s.in_flight.empty());
+}
+
+void call_fn_value(const Any& fn, std::span<Any> inputs, std::span<const Any*> borrowed_inputs, Any* outputs) {
+  assert(native_context.p);
+  const Program& p = *native_context.p;
+  const Inst inst = any_cast<Inst>(fn);
+  const Program& owner = p.owner(inst);
+
+  Executor ex = make_seq_executor();
+  bool finished = false;
+  execute(p,
+          ex,
+          inst,
+          inputs,
+          borrowed_inputs,
+          {outputs, size_t(owner.output_counts[owner.index(inst)])},
+          0,
+          [&finished]() { finished = true; });
+  assert(finished);
+}
+
+void for_each_chunk(int size, const std::function<void(int, int)>& body) {
+  const NativeContext ctx = native_context;
+  if(ctx.ex && ctx.ex->parallel()) {
+    tbb::parallel_for(tbb::blocked_range<int>(0, size), [&](const tbb::blocked_range<int>& r) {
+      const NativeContextGuard guard(ctx);
+      body(r.begin(), r.end());
+    });
+  } else {
+    body(0, size);
+  }
+}
+
 } // namespace ooze
@@ -6,7 +6,9 @@
 #include "ooze/executor.h"
 #include "ooze/future.h"
 
+#include <functional>
 #include <memory>
+#include <optional>
 
 namespace ooze {
 
@@ -17,4 +19,24 @@ void execute(std::shared_ptr<const Program>,
              std::vector<BorrowedFuture>,
              std::span<Future> output);
 
+// Only runs the nodes of a graph that the requested outputs depend on or that have side effects, the other outputs are
+// left invalid
+void execute_lazy(std::shared_ptr<const Program>,
+                  Inst,
+                  Executor&,
+                  std::vector<Future>,
+                  std::vector<BorrowedFuture>,
+                  std::span<Future> output,
+                  const std::vector<bool>& requested);
+
+// Runs inst on each set of owned inputs pulled from source until it runs out, keeping up to window invocations in
+// flight so successive invocations overlap. Outputs are passed to sink in the order their inputs were pulled. source
+// and sink may be called from the executor's threads but never concurrently. Returns once the executor is idle.
+void execute_stream(std::shared_ptr<const Program>,
+                    Inst,
+                    Executor&,
+                    int window,
+                    const std::function<std::optional<std::vector<Any>>()>& source,
+                    const std::function<void(std::vector<Any>)>& sink);
+
 } // namespace ooze
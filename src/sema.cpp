@@ -8,26 +8,45 @@ namespace ooze {
 
 namespace {
 
+// Globals and submodules of a module by name, overloads are kept in declaration order
+struct ModuleSymbols {
+  Map<std::string_view, std::vector<ASTID>> globals;
+  Map<std::string_view, ASTID> modules;
+};
+
 struct IdentGraphCtx {
   std::vector<std::vector<ASTID>> fanouts;
   std::vector<std::pair<std::string_view, ASTID>> stack;
 
+  // Built the first time a module is referenced in a pass
+  Map<ASTID, ModuleSymbols> symbols;
+
   std::vector<ASTID> undeclared_bindings;
 };
 
-std::optional<std::pair<ASTID, ASTID>>
-find_module(Span<std::string_view> srcs, const AST& ast, ASTID module, ASTID qualified) {
+const ModuleSymbols& module_symbols(IdentGraphCtx& ctx, Span<std::string_view> srcs, const AST& ast, ASTID module) {
+  const auto [it, inserted] = ctx.symbols.try_emplace(module);
+  if(inserted) {
+    for(const ASTID id : ast.forest.child_ids(module)) {
+      if(ast.forest[id] == ASTTag::Assignment) {
+        const ASTID pattern_id = ast.forest.child_ids(id).get<0>();
+        it->second.globals[sv(srcs, ast.srcs[pattern_id.get()])].push_back(pattern_id);
+      } else if(ast.forest[id] == ASTTag::Module) {
+        it->second.modules.emplace(sv(srcs, ast.srcs[id.get()]), id);
+      }
+    }
+  }
+  return it->second;
+}
 
+std::optional<std::pair<ASTID, ASTID>>
+find_module(IdentGraphCtx& ctx, Span<std::string_view> srcs, const AST& ast, ASTID module, ASTID qualified) {
   ASTID ref = *ast.forest.first_child(qualified);
   while(ast.forest[ref] == ASTTag::ModuleRef) {
-    const std::string_view name = sv(srcs, ast.srcs[ref.get()]);
+    const ModuleSymbols& symbols = module_symbols(ctx, srcs, ast, module);
 
-    const auto opt = find_if_opt(ast.forest.child_ids(module), [&](ASTID id) {
-      return ast.forest[id] == ASTTag::Module && name == sv(srcs, ast.srcs[id.get()]);
-    });
-
-    if(opt) {
-      module = *opt;
+    if(const auto it = symbols.modules.find(sv(srcs, ast.srcs[ref.get()])); it != symbols.modules.end()) {
+      module = it->second;
     } else {
       return std::nullopt;
     }
@@ -38,19 +57,13 @@ find_module(Span<std::string_view> srcs, const AST& ast, ASTID module, ASTID qua
   return std::pair(module, ref);
 }
 
-void append_globals(Span<std::string_view> srcs,
-                    const AST& ast,
-                    std::vector<std::vector<ASTID>>& fanouts,
-                    std::string_view name,
-                    ASTID module,
-                    ASTID ident) {
-  for(const ASTID id : ast.forest.child_ids(module)) {
-    if(ast.forest[id] == ASTTag::Assignment) {
-      const ASTID pattern_id = ast.forest.child_ids(id).get<0>();
-      if(name == sv(srcs, ast.srcs[pattern_id.get()])) {
-        fanouts[ident.get()].push_back(pattern_id);
-        fanouts[pattern_id.get()].push_back(ident);
-      }
+void append_globals(
+  IdentGraphCtx& ctx, Span<std::string_view> srcs, const AST& ast, std::string_view name, ASTID module, ASTID ident) {
+  const ModuleSymbols& symbols = module_symbols(ctx, srcs, ast, module);
+  if(const auto it = symbols.globals.find(name); it != symbols.globals.end()) {
+    for(const ASTID pattern_id : it->second) {
+      ctx.fanouts[ident.get()].push_back(pattern_id);
+      ctx.fanouts[pattern_id.get()].push_back(ident);
     }
   }
 }
@@ -77,10 +90,10 @@ void calculate_ident_graph(
       ctx.fanouts[id.get()].push_back(pattern_id);
       ctx.fanouts[pattern_id.get()].push_back(id);
     } else {
-      append_globals(srcs, ast, ctx.fanouts, sv(srcs, ast.srcs[id.get()]), module, id);
+      append_globals(ctx, srcs, ast, ident, module, id);
 
       for(ASTID import_module : global_imports) {
-        append_globals(srcs, ast, ctx.fanouts, sv(srcs, ast.srcs[id.get()]), import_module, id);
+        append_globals(ctx, srcs, ast, ident, import_module, id);
       }
 
       if(ctx.fanouts[id.get()].empty()) {
@@ -90,9 +103,9 @@ void calculate_ident_graph(
     break;
   }
   case ASTTag::ExprQualified: {
-    if(const auto opt = find_module(srcs, ast, module, id); opt) {
+    if(const auto opt = find_module(ctx, srcs, ast, module, id); opt) {
       const auto [qual_module, expr_ident] = *opt;
-      append_globals(srcs, ast, ctx.fanouts, sv(srcs, ast.srcs[expr_ident.get()]), qual_module, expr_ident);
+      append_globals(ctx, srcs, ast, sv(srcs, ast.srcs[expr_ident.get()]), qual_module, expr_ident);
 
       if(ctx.fanouts[expr_ident.get()].empty()) {
         ctx.undeclared_bindings.push_back(expr_ident);
@@ -237,25 +250,38 @@ auto find_ident_value_captures(const AST& ast, const Map<ASTID, ASTID>& overload
 
 } // namespace
 
-ContextualResult<void, TypeGraph>
+ContextualResult<std::vector<Type>, AST>
 type_name_resolution(Span<std::string_view> srcs,
                      const TypeNames& type_names,
                      const std::vector<std::pair<Type, SrcRef>>& type_srcs,
-                     TypeGraph tg) {
+                     AST ast) {
 
   assert(std::is_sorted(type_names.begin(), type_names.end()));
 
   std::vector<ContextualError> errors;
+  Type first = Type(ast.tg.num_nodes());
 
   for(const auto& [t, src] : type_srcs) {
     if(const auto opt_id = find_id(type_names, sv(srcs, src)); opt_id) {
-      tg.set<TypeID>(t, *opt_id);
+      ast.tg.name_leaf(t, *opt_id);
+      first = std::min(first, t);
     } else {
       errors.push_back({src, "undefined type"});
     }
   }
 
-  return void_or_errors(std::move(errors), std::move(tg));
+  if(!errors.empty()) {
+    return {Failure{std::move(errors)}, std::move(ast)};
+  }
+
+  std::vector<Type> canonical = ast.tg.canonical_nodes(first);
+  for(Type& t : ast.types) {
+    if(t.is_valid() && t.get() < int(canonical.size())) {
+      t = canonical[t.get()];
+    }
+  }
+
+  return {std::move(canonical), std::move(ast)};
 }
 
 ContextualResult<Graph<ASTID>>
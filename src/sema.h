@@ -9,8 +9,9 @@
 
 namespace ooze {
 
-ContextualResult<void, TypeGraph>
-type_name_resolution(Span<std::string_view>, const TypeNames&, const std::vector<std::pair<Type, SrcRef>>&, TypeGraph);
+// Names the parsed type leaves and replaces the AST's types with their canonical nodes, returning that mapping
+ContextualResult<std::vector<Type>, AST>
+type_name_resolution(Span<std::string_view>, const TypeNames&, const std::vector<std::pair<Type, SrcRef>>&, AST);
 
 ContextualResult<Graph<ASTID>>
 calculate_ident_graph(Span<std::string_view>, const AST&, Span<ASTID> roots, Span<ASTID> global_imports = {});
@@ -0,0 +1,604 @@
+#include "pch.h"
+
+#include "serialization.h"
+
+namespace ooze {
+
+namespace {
+
+constexpr u8 InstValueTag = u8(std::variant_size_v<Literal>);
+constexpr u8 FoldedValueTag = InstValueTag + 1;
+
+template <typename T, typename F>
+void write_vector(BinaryWriter& w, const std::vector<T>& v, F f) {
+  w.write(u64(v.size()));
+  for(const T& t : v) {
+    f(t);
+  }
+}
+
+template <typename F>
+auto read_vector(BinaryReader& r, F f) {
+  const size_t size = r.read_size();
+  std::vector<decltype(f())> v;
+  v.reserve(size);
+  for(size_t i = 0; i < size && r.ok(); i++) {
+    v.push_back(f());
+  }
+  return v;
+}
+
+template <typename T>
+void write_value(BinaryWriter& w, const T& t) {
+  if constexpr(std::is_same_v<T, std::string>) {
+    w.write(std::string_view(t));
+  } else {
+    w.write(t);
+  }
+}
+
+template <typename T>
+T read_value(BinaryReader& r) {
+  if constexpr(std::is_same_v<T, std::string>) {
+    return r.read_string();
+  } else {
+    return r.read<T>();
+  }
+}
+
+template <typename ID>
+ID read_id(BinaryReader& r) {
+  return ID(r.read<typename ID::underlying_type>());
+}
+
+template <size_t... Is>
+Literal read_literal(BinaryReader& r, u8 index, std::index_sequence<Is...>) {
+  Literal literal;
+  const bool found =
+    ((index == Is ? (literal = read_value<std::variant_alternative_t<Is, Literal>>(r), true) : false) || ...);
+  if(!found) {
+    r.fail();
+  }
+  return literal;
+}
+
+template <size_t... Is>
+std::optional<Literal> as_literal(const Any& any, std::index_sequence<Is...>) {
+  std::optional<Literal> literal;
+  (void)((any_cast<std::variant_alternative_t<Is, Literal>>(&any)
+            ? (literal = *any_cast<std::variant_alternative_t<Is, Literal>>(&any), true)
+            : false) ||
+         ...);
+  return literal;
+}
+
+void write_literal(BinaryWriter& w, const Literal& literal) {
+  w.write(u8(literal.index()));
+  std::visit([&](const auto& v) { write_value(w, v); }, literal);
+}
+
+Literal read_literal(BinaryReader& r) {
+  return read_literal(r, r.read<u8>(), std::make_index_sequence<std::variant_size_v<Literal>>());
+}
+
+void write_term(BinaryWriter& w, Term t) {
+  w.write(t.node_id);
+  w.write(t.port);
+}
+
+Term read_term(BinaryReader& r) {
+  const int node_id = r.read<int>();
+  return {node_id, r.read<int>()};
+}
+
+void write_fwd(BinaryWriter& w, const ValueForward& fwd) {
+  write_vector(w, fwd.terms, [&](Term t) { write_term(w, t); });
+  w.write(fwd.copy_end);
+  w.write(fwd.move_end);
+  w.write(fwd.cleanup_idx);
+}
+
+ValueForward read_fwd(BinaryReader& r) {
+  ValueForward fwd;
+  fwd.terms = read_vector(r, [&]() { return read_term(r); });
+  fwd.copy_end = r.read<int>();
+  fwd.move_end = r.read<int>();
+  fwd.cleanup_idx = r.read<int>();
+  return fwd;
+}
+
+StringResult<void> write_type_id(BinaryWriter& w, const TypeTable& table, TypeID id) {
+  if(id == TypeID{}) {
+    w.write(i32(-1));
+    return {};
+  } else if(const auto it = stdr::find(table, id); it != table.end()) {
+    w.write(i32(it - table.begin()));
+    return {};
+  } else {
+    return err("Type is not part of the native registry");
+  }
+}
+
+TypeID read_type_id(BinaryReader& r, const TypeTable& table) {
+  const i32 idx = r.read<i32>();
+  if(idx == -1) {
+    return TypeID{};
+  } else if(idx >= 0 && idx < std::ssize(table)) {
+    return table[idx];
+  } else {
+    r.fail();
+    return TypeID{};
+  }
+}
+
+bool valid_inst(const Program& p, Inst inst) { return inst.get() >= 0 && inst.get() < std::ssize(p.inst); }
+
+// Folds have to call a pure native with the inputs it takes, on values read before the one they fold
+bool valid_fold(
+  const Program& p, Inst value, i32 index, const FoldedValue& fold, Span<std::pair<int, int>> native_input_counts) {
+  const auto value_index = [&](Inst v) {
+    return valid_inst(p, v) && p.inst[v.get()] == InstOp::Value ? p.inst_data[v.get()] : -1;
+  };
+  const auto earlier = [&](Inst v) { return value_index(v) >= 0 && value_index(v) < index; };
+
+  if(value_index(value) != index || !valid_inst(p, fold.fn) || p.inst[fold.fn.get()] != InstOp::Fn) {
+    return false;
+  }
+
+  const i32 fn = p.inst_data[fold.fn.get()];
+  return fn < std::ssize(native_input_counts) && p.fn_purities[fn] == Purity::Pure &&
+         native_input_counts[fn] == std::pair(int(fold.values.size()), int(fold.borrows.size())) &&
+         fold.output >= 0 && fold.output < p.output_counts[fold.fn.get()] && stdr::all_of(fold.values, earlier) &&
+         stdr::all_of(fold.borrows, earlier);
+}
+
+bool valid_inst_data(const Program& p, InstOp op, i32 data) {
+  const auto in = [&](const auto& v) { return data >= 0 && data < std::ssize(v); };
+
+  switch(op) {
+  case InstOp::Value: return in(p.values);
+  case InstOp::Fn: return in(p.fns);
+  case InstOp::Graph: return in(p.graphs);
+  case InstOp::If: return in(p.ifs);
+  case InstOp::Curry: return in(p.currys);
+  case InstOp::Functional:
+  case InstOp::Placeholder: return true;
+  }
+  return false;
+}
+
+// Every node input, borrowed input and graph output has to be forwarded exactly once, and every index has to be within
+// the graph, otherwise making its frame layout or running it would index out of bounds
+bool valid_graph(const Program& p, const FunctionGraph& g) {
+  const int n = int(g.insts.size());
+  if(g.output_count < 0 || std::ssize(g.input_counts) != n || std::ssize(g.owned_fwds) != n + 1 ||
+     std::ssize(g.node_borrows) != n || (g.tailcall && (*g.tailcall < 0 || *g.tailcall >= n)) ||
+     std::ssize(g.owned_fwds[0]) != stdr::count(g.input_borrows, false) ||
+     std::ssize(g.input_borrowed_fwds) != stdr::count(g.input_borrows, true)) {
+    return false;
+  }
+
+  for(int i = 0; i < n; i++) {
+    const Program& owner = p.owner(g.insts[i]);
+    if(g.input_counts[i].first < 0 || g.input_counts[i].second < 0 ||
+       std::ssize(g.owned_fwds[i + 1]) != owner.output_counts[owner.index(g.insts[i])]) {
+      return false;
+    }
+  }
+
+  // Times each slot is forwarded to, the output node only has owned slots
+  std::vector<std::vector<int>> owned(n + 1);
+  std::vector<std::vector<int>> borrowed(n + 1);
+  for(int i = 0; i < n; i++) {
+    owned[i].resize(g.input_counts[i].first);
+    borrowed[i].resize(g.input_counts[i].second);
+  }
+  owned[n].resize(g.output_count);
+
+  const auto fwd = [](std::vector<std::vector<int>>& slots, Term t) {
+    if(t.node_id < 0 || t.node_id >= std::ssize(slots) || t.port < 0 || t.port >= std::ssize(slots[t.node_id])) {
+      return false;
+    }
+    slots[t.node_id][t.port]++;
+    return true;
+  };
+
+  const auto valid_fwd = [&](const ValueForward& f) {
+    const int size = int(f.terms.size());
+    if(f.copy_end < 0 || f.copy_end > f.move_end || f.move_end > size) {
+      return false;
+    } else if(f.move_end != size && (f.cleanup_idx < 0 || f.cleanup_idx >= std::ssize(g.borrow_cleanups))) {
+      return false;
+    }
+
+    bool valid = true;
+    for(int u = 0; u < f.copy_end; u++) {
+      valid = fwd(owned, f.terms[u]) && valid;
+    }
+
+    if(f.move_end != size) {
+      for(int u = f.move_end; u < size; u++) {
+        valid = fwd(borrowed, f.terms[u]) && valid;
+      }
+    } else if(f.copy_end != f.move_end) {
+      valid = fwd(owned, f.terms[f.copy_end]) && valid;
+    }
+    return valid;
+  };
+
+  for(const std::vector<ValueForward>& fwds : g.owned_fwds) {
+    if(!stdr::all_of(fwds, valid_fwd)) {
+      return false;
+    }
+  }
+
+  // Borrowed graph inputs are copied to the terms before copy_end and borrowed by the rest
+  for(const ValueForward& f : g.input_borrowed_fwds) {
+    if(f.copy_end < 0 || f.copy_end != f.move_end || f.move_end > std::ssize(f.terms)) {
+      return false;
+    }
+    for(int u = 0; u < std::ssize(f.terms); u++) {
+      if(!fwd(u < f.copy_end ? owned : borrowed, f.terms[u])) {
+        return false;
+      }
+    }
+  }
+
+  std::vector<int> cleanup_counts(g.borrow_cleanups.size());
+  for(const std::vector<int>& borrows : g.node_borrows) {
+    for(const int cleanup_idx : borrows) {
+      if(cleanup_idx < 0 || cleanup_idx >= std::ssize(cleanup_counts)) {
+        return false;
+      }
+      cleanup_counts[cleanup_idx]++;
+    }
+  }
+
+  for(size_t i = 0; i < g.borrow_cleanups.size(); i++) {
+    const BorrowCleanup& cleanup = g.borrow_cleanups[i];
+    if(cleanup.count != cleanup_counts[i] || (cleanup.fwd && !fwd(owned, *cleanup.fwd))) {
+      return false;
+    }
+  }
+
+  const auto once = [](const std::vector<int>& slots) { return stdr::all_of(slots, [](int c) { return c == 1; }); };
+  return stdr::all_of(owned, once) && stdr::all_of(borrowed, once);
+}
+
+} // namespace
+
+StringResult<void> write(BinaryWriter& w, const TypeTable& table, const AST& ast) {
+  write_vector(w, ast.forest.connectivity(), [&](const auto& c) {
+    w.write(c.parent.get());
+    w.write(c.next_sibling.get());
+    w.write(c.first_child.get());
+  });
+  for(const ASTTag tag : ast.forest.values()) {
+    w.write(tag);
+  }
+  w.write(ast.forest.first_root().value_or(ASTID{}).get());
+
+  write_vector(w, ast.srcs, [&](SrcRef ref) {
+    w.write(ref.file.get());
+    w.write(ref.slice.begin);
+    w.write(ref.slice.end);
+  });
+  write_vector(w, ast.types, [&](Type t) { w.write(t.get()); });
+
+  write_vector(w, ast.literals, [&](const auto& p) {
+    w.write(p.first.get());
+    write_literal(w, p.second);
+  });
+
+  w.write(u64(ast.tg.num_nodes()));
+  for(const Type t : ast.tg.nodes()) {
+    w.write(u64(ast.tg.num_fanout(t)));
+    for(const Type fanout : ast.tg.fanout(t)) {
+      w.write(fanout.get());
+    }
+    w.write(ast.tg.get<TypeTag>(t));
+    if(auto result = write_type_id(w, table, ast.tg.get<TypeID>(t)); !result) {
+      return result;
+    }
+  }
+
+  return {};
+}
+
+AST read_ast(BinaryReader& r, const TypeTable& table) {
+  using Connectivity = Forest<ASTTag, ASTID>::Connectivity;
+
+  AST ast;
+
+  auto connectivity = read_vector(r, [&]() {
+    const ASTID parent = read_id<ASTID>(r);
+    const ASTID next_sibling = read_id<ASTID>(r);
+    return Connectivity{parent, next_sibling, read_id<ASTID>(r)};
+  });
+
+  std::vector<ASTTag> tags;
+  tags.reserve(connectivity.size());
+  for(size_t i = 0; i < connectivity.size() && r.ok(); i++) {
+    tags.push_back(r.read<ASTTag>());
+  }
+
+  const ASTID first_root = read_id<ASTID>(r);
+  if(r.ok()) {
+    ast.forest = Forest<ASTTag, ASTID>(std::move(tags), std::move(connectivity), first_root);
+  }
+
+  ast.srcs = read_vector(r, [&]() {
+    const SrcID file = read_id<SrcID>(r);
+    const int begin = r.read<int>();
+    return SrcRef{file, {begin, r.read<int>()}};
+  });
+  ast.types = read_vector(r, [&]() { return read_id<Type>(r); });
+
+  ast.literals = read_vector(r, [&]() {
+    const ASTID id = read_id<ASTID>(r);
+    return std::pair(id, read_literal(r));
+  });
+
+  // Added without interning since the ids have to match the ones written
+  Graph<Type, TypeTag, TypeID> tg;
+  const size_t num_nodes = r.read_size();
+  tg.reserve_nodes(num_nodes);
+  for(size_t i = 0; i < num_nodes && r.ok(); i++) {
+    std::vector<Type> fanout = read_vector(r, [&]() { return read_id<Type>(r); });
+    const TypeTag tag = r.read<TypeTag>();
+    tg.add_node(fanout, tag, read_type_id(r, table));
+  }
+  ast.tg = TypeGraph(std::move(tg));
+
+  return ast;
+}
+
+void write(BinaryWriter& w, const FunctionGraph& g) {
+  write_vector(w, g.input_borrows, [&](bool b) { w.write(b); });
+  w.write(g.output_count);
+
+  write_vector(w, g.owned_fwds, [&](const auto& fwds) {
+    write_vector(w, fwds, [&](const ValueForward& fwd) { write_fwd(w, fwd); });
+  });
+  write_vector(w, g.input_borrowed_fwds, [&](const ValueForward& fwd) { write_fwd(w, fwd); });
+
+  write_vector(w, g.input_counts, [&](std::pair<int, int> p) {
+    w.write(p.first);
+    w.write(p.second);
+  });
+  write_vector(w, g.insts, [&](Inst inst) { w.write(inst.get()); });
+
+  write_vector(w, g.borrow_cleanups, [&](const BorrowCleanup& cleanup) {
+    w.write(cleanup.count);
+    w.write(cleanup.fwd.has_value());
+    if(cleanup.fwd) {
+      write_term(w, *cleanup.fwd);
+    }
+  });
+  write_vector(w, g.node_borrows, [&](const auto& borrows) { write_vector(w, borrows, [&](int b) { w.write(b); }); });
+
+  w.write(g.tailcall.has_value());
+  w.write(g.tailcall.value_or(0));
+}
+
+FunctionGraph read_function_graph(BinaryReader& r) {
+  FunctionGraph g;
+
+  g.input_borrows = read_vector(r, [&]() { return r.read<bool>(); });
+  g.output_count = r.read<int>();
+
+  g.owned_fwds = read_vector(r, [&]() { return read_vector(r, [&]() { return read_fwd(r); }); });
+  g.input_borrowed_fwds = read_vector(r, [&]() { return read_fwd(r); });
+
+  g.input_counts = read_vector(r, [&]() {
+    const int owned = r.read<int>();
+    return std::pair(owned, r.read<int>());
+  });
+  g.insts = read_vector(r, [&]() { return read_id<Inst>(r); });
+
+  g.borrow_cleanups = read_vector(r, [&]() {
+    BorrowCleanup cleanup{r.read<int>()};
+    if(r.read<bool>()) {
+      cleanup.fwd = read_term(r);
+    }
+    return cleanup;
+  });
+  g.node_borrows = read_vector(r, [&]() { return read_vector(r, [&]() { return r.read<int>(); }); });
+
+  const bool has_tailcall = r.read<bool>();
+  const int tailcall = r.read<int>();
+  if(has_tailcall) {
+    g.tailcall = tailcall;
+  }
+
+  return g;
+}
+
+StringResult<void> write(BinaryWriter& w, const Program& p) {
+  assert(!p.base);
+
+  std::vector<std::string> errors;
+
+  write_vector(w, p.inst, [&](InstOp op) { w.write(op); });
+  write_vector(w, p.output_counts, [&](i32 c) { w.write(c); });
+  write_vector(w, p.inst_data, [&](i32 d) { w.write(d); });
+
+  std::vector<Inst> value_insts(p.values.size());
+  for(i32 i = 0; i < i32(p.inst.size()); i++) {
+    if(p.inst[i] == InstOp::Value) {
+      value_insts[p.inst_data[i]] = Inst(i);
+    }
+  }
+
+  // Values that aren't literals are written as the fold they came from and recomputed when read
+  w.write(u64(p.values.size()));
+  for(size_t i = 0; i < p.values.size(); i++) {
+    const Any& any = p.values[i];
+    if(const Inst* inst = any_cast<Inst>(&any); inst) {
+      w.write(InstValueTag);
+      w.write(inst->get());
+    } else if(const auto literal = as_literal(any, std::make_index_sequence<std::variant_size_v<Literal>>()); literal) {
+      write_literal(w, *literal);
+    } else if(const auto it = p.folds.find(value_insts[i]); it != p.folds.end()) {
+      const FoldedValue& fold = it->second;
+      w.write(FoldedValueTag);
+      w.write(value_insts[i].get());
+      w.write(fold.fn.get());
+      w.write(fold.output);
+      write_vector(w, fold.values, [&](Inst v) { w.write(v.get()); });
+      write_vector(w, fold.borrows, [&](Inst v) { w.write(v.get()); });
+    } else {
+      errors.push_back("Program contains a value that isn't a literal");
+    }
+  }
+
+  w.write(u64(p.fns.size()));
+  write_vector(w, p.graphs, [&](const FunctionGraph& g) { write(w, g); });
+
+  write_vector(w, p.ifs, [&](const IfInst& i) {
+    w.write(i.if_inst.get());
+    w.write(i.else_inst.get());
+    for(const i32 offset : i.value_offsets) w.write(offset);
+    for(const i32 offset : i.borrow_offsets) w.write(offset);
+  });
+
+  write_vector(w, p.currys, [&](const std::pair<Inst, Slice>& c) {
+    w.write(c.first.get());
+    w.write(c.second.begin);
+    w.write(c.second.end);
+  });
+
+  w.write(u64(p.names.size()));
+  for(const auto& [inst, name] : p.names) {
+    w.write(inst.get());
+    w.write(std::string_view(name));
+  }
+
+  return void_or_errors(std::move(errors));
+}
+
+Program read_program(BinaryReader& r, Program p, Span<std::pair<int, int>> native_input_counts) {
+  p.inst = read_vector(r, [&]() { return r.read<InstOp>(); });
+  p.output_counts = read_vector(r, [&]() { return r.read<i32>(); });
+  p.inst_data = read_vector(r, [&]() { return r.read<i32>(); });
+
+  // Folded values are left empty until everything they refer to is validated
+  std::vector<std::pair<i32, Inst>> folded;
+  i32 value_count = 0;
+  p.values = read_vector(r, [&]() {
+    const i32 index = value_count++;
+    if(const u8 tag = r.read<u8>(); tag == InstValueTag) {
+      return Any(read_id<Inst>(r));
+    } else if(tag == FoldedValueTag) {
+      const Inst value = read_id<Inst>(r);
+      FoldedValue fold{read_id<Inst>(r)};
+      fold.output = r.read<i32>();
+      fold.values = read_vector(r, [&]() { return read_id<Inst>(r); });
+      fold.borrows = read_vector(r, [&]() { return read_id<Inst>(r); });
+      if(!p.folds.emplace(value, std::move(fold)).second) {
+        r.fail();
+      }
+      folded.emplace_back(index, value);
+      return Any();
+    } else {
+      return std::visit([](auto v) { return Any(std::move(v)); },
+                        read_literal(r, tag, std::make_index_sequence<std::variant_size_v<Literal>>()));
+    }
+  });
+
+  if(r.read<u64>() != p.fns.size()) {
+    r.fail();
+  }
+
+  p.graphs = read_vector(r, [&]() { return read_function_graph(r); });
+
+  p.ifs = read_vector(r, [&]() {
+    IfInst i{read_id<Inst>(r), read_id<Inst>(r)};
+    for(i32& offset : i.value_offsets) offset = r.read<i32>();
+    for(i32& offset : i.borrow_offsets) offset = r.read<i32>();
+    return i;
+  });
+
+  p.currys = read_vector(r, [&]() {
+    const Inst inst = read_id<Inst>(r);
+    const int begin = r.read<int>();
+    return std::pair(inst, Slice{begin, r.read<int>()});
+  });
+
+  p.names.clear();
+  const size_t name_count = r.read_size();
+  for(size_t i = 0; i < name_count && r.ok(); i++) {
+    const Inst inst = read_id<Inst>(r);
+    p.names.emplace(inst, r.read_string());
+  }
+
+  if(!r.ok()) {
+    return p;
+  }
+
+  // Every inst has to refer to valid data or the runtime will index out of bounds
+  if(p.output_counts.size() != p.inst.size() || p.inst_data.size() != p.inst.size()) {
+    r.fail();
+  }
+
+  for(size_t i = 0; i < p.inst.size() && r.ok(); i++) {
+    if(!valid_inst_data(p, p.inst[i], p.inst_data[i])) {
+      r.fail();
+    }
+  }
+
+  for(const Any& value : p.values) {
+    if(const Inst* inst = any_cast<Inst>(&value); inst && !valid_inst(p, *inst)) {
+      r.fail();
+    }
+  }
+
+  for(const FunctionGraph& g : p.graphs) {
+    if(!stdr::all_of(g.insts, [&](Inst inst) { return valid_inst(p, inst); }) || (r.ok() && !valid_graph(p, g))) {
+      r.fail();
+    }
+  }
+
+  const auto ordered = [](std::array<i32, 2> offsets) { return 0 <= offsets[0] && offsets[0] <= offsets[1]; };
+  for(const IfInst& i : p.ifs) {
+    if(!valid_inst(p, i.if_inst) || !valid_inst(p, i.else_inst) || !ordered(i.value_offsets) ||
+       !ordered(i.borrow_offsets)) {
+      r.fail();
+    }
+  }
+
+  for(const auto& [inst, slice] : p.currys) {
+    if(!valid_inst(p, inst) || slice.begin < 0 || slice.begin > slice.end || slice.end > std::ssize(p.values)) {
+      r.fail();
+    }
+  }
+
+  // Folds are recomputed in order so the values they take are already there
+  for(const auto& [index, value] : folded) {
+    if(!r.ok()) {
+      break;
+    }
+
+    const FoldedValue& fold = p.folds.at(value);
+    if(auto outputs = valid_fold(p, value, index, fold, native_input_counts)
+                        ? evaluate(p, fold.fn, fold.values, fold.borrows)
+                        : std::nullopt;
+       outputs) {
+      p.values[index] = std::move((*outputs)[fold.output]);
+    } else {
+      r.fail();
+    }
+  }
+
+  // Frames are only laid out once the graphs are known to be well formed
+  if(r.ok()) {
+    p.frames = transform_to_vec(p.graphs, make_frame_layout);
+    p.max_arity = fold(p.graphs, i32(0), [](i32 acc, const FunctionGraph& g) {
+      return std::max(acc, i32(g.input_borrows.size()));
+    });
+  }
+
+  return p;
+}
+
+} // namespace ooze
@@ -0,0 +1,113 @@
+#pragma once
+
+#include "ast.h"
+#include "program.h"
+
+#include <cstring>
+
+namespace ooze {
+
+// Appends raw values to a byte buffer, only meant to be read back by the same build
+class BinaryWriter {
+  std::vector<std::byte> _bytes;
+
+public:
+  template <typename T>
+    requires std::is_arithmetic_v<T> || std::is_enum_v<T>
+  void write(T t) {
+    if constexpr(std::is_same_v<T, bool>) {
+      write(u8(t));
+    } else {
+      const auto* ptr = reinterpret_cast<const std::byte*>(&t);
+      _bytes.insert(_bytes.end(), ptr, ptr + sizeof(T));
+    }
+  }
+
+  void write(std::string_view str) {
+    write(u64(str.size()));
+    const auto* ptr = reinterpret_cast<const std::byte*>(str.data());
+    _bytes.insert(_bytes.end(), ptr, ptr + str.size());
+  }
+
+  std::vector<std::byte> bytes() && { return std::move(_bytes); }
+};
+
+// Reads values written by a BinaryWriter, any malformed read fails the reader instead of the caller
+class BinaryReader {
+  Span<std::byte> _bytes;
+  size_t _pos = 0;
+  bool _failed = false;
+
+public:
+  explicit BinaryReader(Span<std::byte> bytes) : _bytes(bytes) {}
+
+  template <typename T>
+    requires std::is_arithmetic_v<T> || std::is_enum_v<T>
+  T read() {
+    if constexpr(std::is_same_v<T, bool>) {
+      return read<u8>() != 0;
+    } else {
+      T t = {};
+      if(!_failed && _bytes.size() - _pos >= sizeof(T)) {
+        std::memcpy(&t, _bytes.data() + _pos, sizeof(T));
+        _pos += sizeof(T);
+      } else {
+        _failed = true;
+      }
+      return t;
+    }
+  }
+
+  std::string read_string() {
+    const size_t size = read_size();
+    std::string str;
+    if(!_failed) {
+      str.assign(reinterpret_cast<const char*>(_bytes.data() + _pos), size);
+      _pos += size;
+    }
+    return str;
+  }
+
+  // Every element takes at least a byte so larger sizes can only come from corrupt input
+  size_t read_size() {
+    const u64 size = read<u64>();
+    if(size > _bytes.size() - _pos) {
+      _failed = true;
+    }
+    return _failed ? 0 : size_t(size);
+  }
+
+  void fail() { _failed = true; }
+  bool ok() const { return !_failed; }
+  bool done() const { return _pos == _bytes.size(); }
+};
+
+// FNV-1a, stable across runs unlike std::hash
+inline u64 stable_hash(Span<std::byte> bytes, u64 h = 14695981039346656037ull) {
+  for(const std::byte b : bytes) {
+    h = (h ^ u64(b)) * 1099511628211ull;
+  }
+  return h;
+}
+
+inline u64 stable_hash(std::string_view str, u64 h = 14695981039346656037ull) {
+  return stable_hash(std::as_bytes(std::span(str.data(), str.size())), h);
+}
+
+// TypeIDs are process specific, they're persisted as indices into a table both sides build from the same registry
+using TypeTable = std::vector<TypeID>;
+
+StringResult<void> write(BinaryWriter&, const TypeTable&, const AST&);
+void write(BinaryWriter&, const FunctionGraph&);
+
+// Native fns are written by count only since they can't be persisted, layered programs have to be flattened first
+StringResult<void> write(BinaryWriter&, const Program&);
+
+AST read_ast(BinaryReader&, const TypeTable&);
+FunctionGraph read_function_graph(BinaryReader&);
+
+// Reads everything but the native fns, which are taken from a program holding only those. Values folded from natives
+// are recomputed, taking the owned and borrowed input counts of each native.
+Program read_program(BinaryReader&, Program natives, Span<std::pair<int, int>> native_input_counts);
+
+} // namespace ooze
@@ -68,7 +68,9 @@ bool can_unify(const TypeGraph& g, Type x, Type y) {
   const TypeTag xt = g.get<TypeTag>(x);
   const TypeTag yt = g.get<TypeTag>(y);
 
-  if(xt == TypeTag::Floating) {
+  if(x == y) {
+    return true;
+  } else if(xt == TypeTag::Floating) {
     return true;
   } else if(yt == TypeTag::Floating) {
     return true;
@@ -96,11 +98,9 @@ Type propagated_type(TypeGraph& g, Propagation p, bool wrap, Type t, Type floati
                [&](FloatingProp) { return floating; },
                [&](TupleProp p) {
                  if(wrap) {
-                   const Type type = g.add_node(TypeTag::Tuple, {});
-                   for(int i = 0; i < p.size; i++) {
-                     g.add_fanout_to_last_node(i == p.idx ? t : floating);
-                   }
-                   return type;
+                   std::vector<Type> fanout(p.size, floating);
+                   fanout[p.idx] = t;
+                   return g.add_node(fanout, TypeTag::Tuple, {});
                  } else {
                    return opt_fanout(t, p.idx);
                  }
@@ -610,11 +610,8 @@ Type language_rule(const TypeCache& tc, AST& ast, ASTID id) {
 
   case ASTTag::PatternTuple:
   case ASTTag::ExprTuple: {
-    const Type tuple = ast.tg.add_node(TypeTag::Tuple, TypeID{});
-    for(const ASTID _ : ast.forest.child_ids(id)) {
-      ast.tg.add_fanout_to_last_node(tc.floating);
-    }
-    return tuple;
+    const std::vector<Type> fanout(ast.forest.num_children(id), tc.floating);
+    return ast.tg.add_node(fanout, TypeTag::Tuple, TypeID{});
   }
 
   case ASTTag::Fn: return tc.fn_floating;
@@ -724,7 +721,10 @@ Type unify(const TypeCache& tc, TypeGraph& g, Type x, Type y, bool recurse) {
   const TypeTag xt = g.get<TypeTag>(x);
   const TypeTag yt = g.get<TypeTag>(y);
 
-  if(xt == TypeTag::Floating) {
+  // Interned types are identical only if their ids are, which is the common case once propagation settles
+  if(x == y && recurse) {
+    return x;
+  } else if(xt == TypeTag::Floating) {
     return y;
   } else if(yt == TypeTag::Floating) {
     return x;
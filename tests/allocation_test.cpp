@@ -0,0 +1,74 @@
+#define BOOST_TEST_MODULE ooze_allocation_tests
+#include "test.h"
+
+#include "constructing_graph.h"
+#include "program.h"
+#include "runtime_test.h"
+
+#include "ooze/executor.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+std::atomic<int64_t> allocation_count = 0;
+
+} // namespace
+
+void* operator new(std::size_t n) {
+  allocation_count.fetch_add(1, std::memory_order_relaxed);
+  if(void* p = std::malloc(n == 0 ? 1 : n); p) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+namespace ooze {
+
+BOOST_AUTO_TEST_SUITE(allocation)
+
+// Once warm, the iterations of a loop don't allocate
+BOOST_AUTO_TEST_CASE(tail_recursion) {
+  Program p;
+  const Inst identity = p.add_fn([](int x) { return x; });
+  const Inst is_zero = p.add_fn([](int x) { return x == 0; });
+  const Inst dec = p.add_fn([](int x) { return x - 1; });
+  const Inst loop = p.placeholder();
+  const Inst if_inst = p.add(IfInst{identity, loop, 0, 1}, 1);
+
+  auto [cg, n] = make_graph({false});
+  const auto cond = cg.add(is_zero, n, std::array{PassBy::Copy}, 1);
+  const auto next = cg.add(dec, n, std::array{PassBy::Copy}, 1);
+  const auto result = cg.add(if_inst,
+                             std::array{cond[0], n[0], next[0]},
+                             std::array{PassBy::Move, PassBy::Move, PassBy::Move},
+                             1);
+  p.set(loop, std::move(cg).finalize(result, std::array{PassBy::Move}));
+
+  const auto shared = share(std::move(p));
+  const auto allocations = [&](int n, bool parallel) {
+    Executor ex = parallel ? make_tbb_executor() : make_seq_executor();
+    const int64_t before = allocation_count.load();
+    std::vector<Future> results = execute(shared, loop, ex, std::tuple(n), std::tuple());
+    ex.wait();
+    const int64_t count = allocation_count.load() - before;
+    compare(0, await(std::move(results)));
+    return count;
+  };
+
+  allocations(100'000, false);
+  BOOST_CHECK_EQUAL(allocations(100, false), allocations(100'000, false));
+
+  // The scheduler's own bookkeeping can allocate now and then, but never per iteration
+  allocations(100'000, true);
+  BOOST_CHECK_LT(allocations(100'000, true), 1'000);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+} // namespace ooze
@@ -2,6 +2,8 @@
 
 #include "ooze/any.h"
 
+#include <array>
+
 namespace ooze {
 
 namespace {
@@ -70,6 +72,36 @@ BOOST_AUTO_TEST_CASE(move_only) {
   const MoveOnlyType m = any_cast<MoveOnlyType>(std::move(any2));
 }
 
+BOOST_AUTO_TEST_CASE(inline_and_heap) {
+  using Small = std::array<int, 3>;
+  using Large = std::array<int, 16>;
+
+  const Small small = {1, 2, 3};
+  const Large large = {4, 5, 6};
+
+  Any a = Any(small);
+  Any b = Any(large);
+
+  Any a2 = a;
+  Any b2 = b;
+
+  BOOST_CHECK(small == any_cast<Small>(a2));
+  BOOST_CHECK(large == any_cast<Large>(b2));
+
+  std::swap(a2, b2);
+
+  BOOST_CHECK(type_id(knot::Type<Large>{}) == a2.type());
+  BOOST_CHECK(type_id(knot::Type<Small>{}) == b2.type());
+  BOOST_CHECK(large == any_cast<Large>(a2));
+  BOOST_CHECK(small == any_cast<Small>(b2));
+
+  a = std::move(b);
+
+  BOOST_CHECK(!b.has_value());
+  BOOST_CHECK(large == any_cast<Large>(a));
+  BOOST_CHECK(nullptr == any_cast<Small>(&a));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
 } // namespace ooze
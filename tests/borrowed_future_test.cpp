@@ -78,6 +78,32 @@ BOOST_AUTO_TEST_CASE(then_send) {
   std::move(p).send(Any(1));
 }
 
+BOOST_AUTO_TEST_CASE(then_order) {
+  auto [p, f] = make_promise_future();
+  auto [b, f2] = borrow(std::move(f));
+
+  std::vector<int> order;
+  for(int i = 0; i < 3; i++) {
+    b.then([&, i](const Any&) { order.push_back(i); });
+  }
+
+  std::move(p).send(Any(1));
+  BOOST_CHECK(std::vector<int>({0, 1, 2}) == order);
+}
+
+BOOST_AUTO_TEST_CASE(then_no_send) {
+  auto ptr = std::make_shared<int>(0);
+
+  {
+    auto [p, f] = make_promise_future();
+    auto [b, f2] = borrow(std::move(f));
+    b.then([ptr](const Any&) { BOOST_CHECK(false); });
+    BOOST_CHECK_EQUAL(2, ptr.use_count());
+  }
+
+  BOOST_CHECK_EQUAL(1, ptr.use_count());
+}
+
 BOOST_AUTO_TEST_CASE(stress) {
   constexpr int count = 500;
 
@@ -1,6 +1,7 @@
 #include "test.h"
 
 #include "constructing_graph.h"
+#include "program.h"
 
 #include <algorithm>
 
@@ -235,6 +236,21 @@ BOOST_AUTO_TEST_CASE(add_single_graph_to_single_after) {
   BOOST_CHECK(exp == g);
 }
 
+BOOST_AUTO_TEST_CASE(frame_layout_order) {
+  // A chain of two nodes next to a single node, borrowing from the chain so none of them are tail calls
+  auto [cg, inputs] = make_graph({false});
+  const auto chain1 = cg.add(fn3, inputs, std::array{PassBy::Copy}, 1);
+  const auto chain2 = cg.add(fn3, chain1, std::array{PassBy::Move}, 1);
+  const auto single = cg.add(fn4, inputs, std::array{PassBy::Copy}, 1);
+  const auto borrow = cg.add(fn4, chain2, std::array{PassBy::Borrow}, 1);
+  const FunctionGraph g = std::move(cg).finalize(std::array{single[0], borrow[0], chain2[0]},
+                                                 std::array{PassBy::Move, PassBy::Move, PassBy::Move});
+
+  const FrameLayout layout = make_frame_layout(g);
+  BOOST_CHECK(std::vector<int>({0, 2, 1, 3}) == layout.order);
+  BOOST_CHECK(std::vector<int>({3, 2, 1, 1}) == layout.critical_path);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
 } // namespace ooze
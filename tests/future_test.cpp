@@ -71,6 +71,53 @@ BOOST_AUTO_TEST_CASE(then_then_send) {
   std::move(p).send(Any(1));
 }
 
+BOOST_AUTO_TEST_CASE(move_only_continuation) {
+  auto [p, f] = make_promise_future();
+
+  std::move(f)
+    .then([x = std::make_unique<int>(1)](Any v) { return Any(*x + any_cast<int>(v)); })
+    .then([](Any v) { BOOST_CHECK_EQUAL(3, any_cast<int>(v)); });
+
+  std::move(p).send(Any(2));
+}
+
+BOOST_AUTO_TEST_CASE(large_continuation) {
+  auto [p, f] = make_promise_future();
+
+  std::array<int, 32> xs = {};
+  xs.back() = 1;
+  std::move(f).then([xs](Any v) { BOOST_CHECK_EQUAL(xs.back(), any_cast<int>(v)); });
+
+  std::move(p).send(Any(1));
+}
+
+BOOST_AUTO_TEST_CASE(unsent_continuation_destroyed) {
+  auto ptr = std::make_shared<int>(0);
+
+  {
+    auto [p, f] = make_promise_future();
+    std::move(f).then([ptr](Any) { BOOST_CHECK(false); });
+    BOOST_CHECK_EQUAL(2, ptr.use_count());
+  }
+
+  BOOST_CHECK_EQUAL(1, ptr.use_count());
+}
+
+BOOST_AUTO_TEST_CASE(clone_connect) {
+  auto [p, f] = make_promise_future();
+  auto [f1, f2] = clone(std::move(f));
+
+  auto [p3, f3] = make_promise_future();
+  connect(std::move(f2), std::move(p3));
+
+  int calls = 0;
+  std::move(f1).then([&](Any v) { calls += any_cast<int>(v); });
+  std::move(f3).then([&](Any v) { calls += any_cast<int>(v); });
+
+  std::move(p).send(Any(1));
+  BOOST_CHECK_EQUAL(2, calls);
+}
+
 BOOST_AUTO_TEST_CASE(stress) {
   constexpr int count = 1000;
 
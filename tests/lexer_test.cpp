@@ -101,7 +101,11 @@ BOOST_AUTO_TEST_CASE(other_literals) {
   BOOST_CHECK((std::pair{TokenType::LiteralString, 2}) == lex_one("'''"));
   BOOST_CHECK((std::pair{TokenType::LiteralString, 5}) == lex_one("'abc'"));
 
+  BOOST_CHECK((std::pair{TokenType::LiteralString, 5}) == lex_one("'a\nb' '"));
+  BOOST_CHECK((std::pair{TokenType::Whitespace, 0}) == lex_one("\"abc"));
+
   BOOST_CHECK((std::pair{TokenType::Whitespace, 0}) == lex_one("@"));
+  BOOST_CHECK((std::pair{TokenType::Whitespace, 0}) == lex_one("/x"));
 }
 
 BOOST_AUTO_TEST_CASE(multi) {
@@ -155,6 +155,18 @@ BOOST_AUTO_TEST_CASE(wildcard_assignment) {
   check_run(create_primitive_registry(), script, "f()", "i32", std::tuple(2));
 }
 
+BOOST_AUTO_TEST_CASE(unused_binding) {
+  auto calls = std::make_shared<std::array<int, 2>>();
+  auto r = create_primitive_registry()
+             .add_fn("count", [calls](int x) { return (*calls)[0] += x; })
+             .add_fn("count_impure", [calls](int x) { return (*calls)[1] += x; }, Cost::Unknown, Purity::Impure);
+
+  constexpr std::string_view script = "fn f() -> i32 { let _x = count(1); let _y = count_impure(1); 2 }";
+  check_run(std::move(r), script, "f()", "i32", std::tuple(2));
+  BOOST_CHECK_EQUAL(0, (*calls)[0]);
+  BOOST_CHECK_EQUAL(1, (*calls)[1]);
+}
+
 struct Point {
   int x;
   int y;
@@ -179,6 +191,330 @@ BOOST_AUTO_TEST_CASE(custom_type) {
   check_run(std::move(r), script, "f(create_point(1, 2), create_point(9, 7))", "Point", std::tuple(Point{19, 16}));
 }
 
+BOOST_AUTO_TEST_CASE(parallel_fns) {
+  constexpr std::string_view script =
+    "fn double(x: i32) -> i32 { add(x, x) }\n"
+    "fn sum(x: i32, y: i32) -> i32 { add(x, y) }\n";
+
+  const auto registry = []() {
+    return create_primitive_registry()
+      .add_type<std::vector<i32>>("i32_vector")
+      .add_fn("add", [](i32 x, i32 y) { return x + y; })
+      .add_fn("iota",
+              [](i32 n) {
+                std::vector<i32> v(n);
+                std::iota(v.begin(), v.end(), 0);
+                return v;
+              })
+      .add_parallel_fns<i32>();
+  };
+
+  for(const bool parallel : {false, true}) {
+    Executor ex = parallel ? make_tbb_executor() : make_seq_executor();
+    Env env = check_result(Env(registry()).parse_scripts(make_sv_array(script)));
+
+    Binding sum = check_result(env.run(ex, "par_reduce(sum, par_map(double, iota(1000)), 0)"));
+    Binding range = check_result(env.run(ex, "par_for_range(double, 0, 4)"));
+    ex.wait();
+
+    compare(999'000, await(std::move(sum)).second);
+    compare(std::vector<i32>{0, 2, 4, 6}, await(std::move(range)).second);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(async_fn) {
+  auto mutex = std::make_shared<std::mutex>();
+  auto threads = std::make_shared<std::vector<std::thread>>();
+
+  // Fulfilled from another thread after the native has returned
+  const auto registry = [&]() {
+    return create_primitive_registry()
+      .add_fn("add", [](i32 x, i32 y) { return x + y; })
+      .add_async_fn<i32>("fetch", [mutex, threads](i32 x) {
+        auto [promise, future] = make_promise_future();
+        const std::lock_guard lock(*mutex);
+        threads->emplace_back([x, promise = std::move(promise)]() mutable { std::move(promise).send(Any(x + 1)); });
+        return std::move(future);
+      });
+  };
+
+  constexpr std::string_view script = "fn f(x: i32) -> i32 { add(fetch(x), fetch(add(x, 1))) }";
+
+  for(const bool parallel : {false, true}) {
+    Executor ex = parallel ? make_tbb_executor() : make_seq_executor();
+    Env env = check_result(Env(registry()).parse_scripts(make_sv_array(script)));
+
+    Binding result = check_result(env.run(ex, "f(1)"));
+    ex.wait();
+
+    compare(5, await(std::move(result)).second);
+  }
+
+  for(std::thread& t : *threads) {
+    t.join();
+  }
+}
+
+BOOST_AUTO_TEST_CASE(compiled_env) {
+  constexpr std::string_view script =
+    "fn f(x: i32) -> i32 { add(x, 1) }\n"
+    "fn f(x: i32, y: i32) -> i32 { add(x, y) }\n"
+    "fn g(s: &string) -> i32 { len(s) }\n"
+    "fn h((x, s): (i32, &string)) -> i32 { add(x, len(s)) }\n";
+
+  const auto registry = create_primitive_registry()
+                          .add_fn("add", [](i32 x, i32 y) { return x + y; })
+                          .add_fn("len", [](const std::string& s) { return i32(s.size()); });
+
+  const CompiledEnv compiled = check_result(Env(registry).parse_scripts(make_sv_array(script))).compile();
+
+  const auto input = [](auto x) { return std::pair(Future(Any(x)), type_id<decltype(x)>()); };
+
+  Executor seq = make_seq_executor();
+  check_error(compiled.call(seq, "f", make_vector(input(1))));
+  check_error(compiled.call(seq, "i", {}));
+  check_error(compiled.call(seq, "f", {}, {}, "fn(i32) -> i32"));
+  check_error(compiled.call(seq, "f", make_vector(input(1)), {}, "fn(i32) -> string"));
+  check_error(compiled.call(seq, "f", make_vector(input(std::string("1"))), {}, "fn(i32) -> i32"));
+  check_error(compiled.call(seq, "g", {}, make_vector(std::pair(borrow(Future(Any(1))).first, type_id<i32>()))));
+
+  // Borrows nested in a tuple arg are still borrowed inputs
+  const auto borrowed_input = [](auto x) { return std::pair(borrow(Future(Any(x))).first, type_id<decltype(x)>()); };
+  check_error(compiled.call(seq, "h", make_vector(input(1), input(std::string("ab")))));
+  std::vector<Future> h =
+    check_result(compiled.call(seq, "h", make_vector(input(1)), make_vector(borrowed_input(std::string("ab")))));
+  seq.wait();
+  check_any(3, await(std::move(h[0])));
+
+  // Every thread shares the same program with its own executor and inputs, results are checked once they're joined
+  std::vector<std::vector<std::array<i32, 3>>> results(4);
+  std::vector<std::thread> threads;
+  for(int t = 0; t < 4; t++) {
+    threads.emplace_back([&, t]() {
+      Executor ex = t % 2 == 0 ? make_seq_executor() : make_tbb_executor();
+      for(int i = 0; i < 100; i++) {
+        std::vector<Future> f1 = compiled.call(ex, "f", make_vector(input(i)), {}, "fn(i32) -> i32").value();
+        std::vector<Future> f2 =
+          compiled.call(ex, "f", make_vector(input(i), input(t)), {}, "fn(i32, i32) -> i32").value();
+        auto [borrowed, owned] = borrow(Future(Any(std::string(i, 'a'))));
+        std::vector<Future> g =
+          compiled.call(ex, "g", {}, make_vector(std::pair(std::move(borrowed), type_id<std::string>()))).value();
+        ex.wait();
+
+        results[t].push_back({any_cast<i32>(await(std::move(f1[0]))),
+                              any_cast<i32>(await(std::move(f2[0]))),
+                              any_cast<i32>(await(std::move(g[0])))});
+      }
+    });
+  }
+
+  for(std::thread& t : threads) {
+    t.join();
+  }
+
+  for(int t = 0; t < 4; t++) {
+    BOOST_REQUIRE_EQUAL(100, results[t].size());
+    for(int i = 0; i < 100; i++) {
+      BOOST_CHECK((std::array{i + 1, i + t, i} == results[t][i]));
+    }
+  }
+
+  const auto no_inputs = []() -> std::optional<std::vector<Any>> { return std::nullopt; };
+  const auto ignore = [](std::vector<Any>) {};
+  check_error(compiled.stream(seq, "g", 4, no_inputs, ignore));
+  check_error(compiled.stream(seq, "f", 0, no_inputs, ignore, "fn(i32) -> i32"));
+  check_error(compiled.stream(seq, "f", 4, no_inputs, ignore));
+
+  const auto strings = [&]() -> std::optional<std::vector<Any>> { return make_vector(Any(std::string("1"))); };
+  check_error(compiled.stream(seq, "f", 4, strings, ignore, "fn(i32) -> i32"));
+
+  for(const bool parallel : {false, true}) {
+    Executor ex = parallel ? make_tbb_executor() : make_seq_executor();
+    int pulled = 0;
+    std::vector<i32> streamed;
+    check_result(compiled.stream(
+      ex,
+      "f",
+      4,
+      [&]() -> std::optional<std::vector<Any>> {
+        return pulled == 100 ? std::nullopt : std::optional(make_vector(Any(pulled++), Any(10)));
+      },
+      [&](std::vector<Any> outputs) { streamed.push_back(any_cast<i32>(outputs[0])); },
+      "fn(i32, i32) -> i32"));
+
+    BOOST_REQUIRE_EQUAL(100, streamed.size());
+    for(int i = 0; i < 100; i++) {
+      BOOST_CHECK_EQUAL(i + 10, streamed[i]);
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(reactive) {
+  auto calls = std::make_shared<std::atomic<int>>(0);
+
+  const auto registry = create_primitive_registry()
+                          .add_fn("add", [](i32 x, i32 y) { return x + y; })
+                          .add_fn("twice", [calls](i32 x) {
+                            calls->fetch_add(1);
+                            return 2 * x;
+                          });
+
+  for(const bool parallel : {false, true}) {
+    Executor ex = parallel ? make_tbb_executor() : make_seq_executor();
+    Env env(registry);
+    env.set_reactive(true);
+
+    for(const std::string_view stmt :
+        {"let x = 1;", "let y = 10;", "let a = twice(x);", "let b = twice(y);", "let c = add(a, b);"}) {
+      check_result(env.run(ex, stmt));
+    }
+    ex.wait();
+    BOOST_CHECK_EQUAL(2, calls->exchange(0));
+
+    // Only a and c depend on x
+    check_result(env.insert(ex, "x", 5));
+    Binding c = check_result(env.run(ex, "c"));
+    ex.wait();
+    compare(30, await(std::move(c)).second);
+    BOOST_CHECK_EQUAL(1, calls->exchange(0));
+
+    check_result(env.run(ex, "let y = 20;"));
+    c = check_result(env.run(ex, "c"));
+    ex.wait();
+    compare(50, await(std::move(c)).second);
+    BOOST_CHECK_EQUAL(1, calls->exchange(0));
+
+    // Rebinding a derived binding directly detaches it from what it was assigned from
+    check_result(env.insert(ex, "a", 0));
+    check_result(env.insert(ex, "x", 1));
+    c = check_result(env.run(ex, "c"));
+    ex.wait();
+    compare(40, await(std::move(c)).second);
+    BOOST_CHECK_EQUAL(0, calls->exchange(0));
+
+    env.set_reactive(false);
+    check_result(env.run(ex, "let y = 0;"));
+    c = check_result(env.run(ex, "c"));
+    ex.wait();
+    compare(40, await(std::move(c)).second);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(serialize_scripts) {
+  constexpr std::string_view script =
+    "fn one() -> i32 { 1 }\n"
+    "fn add_one(x: i32) -> i32 { sum(x, one()) }\n"
+    "fn apply(g: fn(i32) -> i32, x) { g(x) }\n"
+    "fn f(s: string) -> string { if true { s } else { 'abc' } }\n";
+
+  const auto registry = [] { return create_primitive_registry().add_fn("sum", [](i32 x, i32 y) { return x + y; }); };
+
+  const Env env = check_result(Env(registry()).parse_scripts(make_sv_array(script)));
+  const std::vector<std::byte> bytes = check_result(env.serialize_scripts(make_sv_array(script)));
+
+  Env loaded(registry());
+  check_result(loaded.deserialize_scripts(bytes, make_sv_array(script)));
+
+  BOOST_CHECK(env.globals() == loaded.globals());
+  check_any(2, execute1(std::move(loaded), "apply(add_one, 1)"));
+
+  Env loaded2(registry());
+  check_result(loaded2.deserialize_scripts(bytes, make_sv_array(script)));
+  check_any(std::string("def"), execute1(std::move(loaded2), "f('def')"));
+}
+
+BOOST_AUTO_TEST_CASE(serialize_scripts_corrupt) {
+  constexpr std::string_view script =
+    "fn add_one(x: i32) -> i32 { sum(x, 1) }\n"
+    "fn apply(g: fn(i32) -> i32, x) { g(x) }\n"
+    "fn f(x: i32, s: &string) -> i32 { if true { apply(add_one, x) } else { len(s) } }\n";
+
+  const auto registry = [] {
+    return create_primitive_registry()
+      .add_fn("sum", [](i32 x, i32 y) { return x + y; })
+      .add_fn("len", [](const std::string& s) { return i32(s.size()); });
+  };
+
+  const Env env = check_result(Env(registry()).parse_scripts(make_sv_array(script)));
+  const std::vector<std::byte> bytes = check_result(env.serialize_scripts(make_sv_array(script)));
+
+  for(size_t size = 0; size < bytes.size(); size++) {
+    Env truncated(registry());
+    check_error(truncated.deserialize_scripts(std::span(bytes).first(size), make_sv_array(script)));
+  }
+
+  // Corrupt bytes are either rejected or still describe a program that's safe to load, whichever it is it can't crash
+  for(size_t i = 0; i < bytes.size(); i++) {
+    for(const std::byte mask : {std::byte{0x01}, std::byte{0xff}}) {
+      std::vector<std::byte> corrupt = bytes;
+      corrupt[i] ^= mask;
+      Env loaded(registry());
+      (void)loaded.deserialize_scripts(corrupt, make_sv_array(script));
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(serialize_scripts_out_of_date) {
+  constexpr std::string_view script = "fn f() -> i32 { 1 }";
+
+  const Env env = check_result(Env(create_primitive_registry()).parse_scripts(make_sv_array(script)));
+  const std::vector<std::byte> bytes = check_result(env.serialize_scripts(make_sv_array(script)));
+
+  Env different_script(create_primitive_registry());
+  check_error(different_script.deserialize_scripts(bytes, make_sv_array("fn f() -> i32 { 2 }")));
+  BOOST_CHECK(different_script.globals().size() < env.globals().size());
+
+  Env different_registry(create_primitive_registry().add_fn("g", []() { return 1; }));
+  check_error(different_registry.deserialize_scripts(bytes, make_sv_array(script)));
+
+  Env truncated(create_primitive_registry());
+  const auto truncated_bytes = std::span<const std::byte>(bytes).first(bytes.size() - 1);
+  check_error(truncated.deserialize_scripts(truncated_bytes, make_sv_array(script)));
+
+  const auto registry_with_g = [](Purity purity) {
+    return create_primitive_registry().add_fn("g", []() { return 1; }, Cost::Unknown, purity);
+  };
+  const Env g_env = check_result(Env(registry_with_g(Purity::Unknown)).parse_scripts(make_sv_array(script)));
+  const std::vector<std::byte> g_bytes = check_result(g_env.serialize_scripts(make_sv_array(script)));
+
+  Env different_purity(registry_with_g(Purity::Pure));
+  check_error(different_purity.deserialize_scripts(g_bytes, make_sv_array(script)));
+
+  Env async_g(create_primitive_registry().add_async_fn<i32>("g", []() { return Future(Any(1)); }));
+  check_error(async_g.deserialize_scripts(g_bytes, make_sv_array(script)));
+}
+
+BOOST_AUTO_TEST_CASE(serialize_scripts_folded_values) {
+  constexpr std::string_view script =
+    "fn origin() -> Point { create_point(1, 2) }\n"
+    "fn shifted() -> Point { shift(&origin(), 3) }\n";
+
+  const auto registry = [] {
+    return create_primitive_registry()
+      .add_type<Point>("Point")
+      .add_fn("create_point", [](i32 x, i32 y) { return Point{x, y}; }, Cost::Unknown, Purity::Pure)
+      .add_fn("shift", [](const Point& p, i32 d) { return Point{p.x + d, p.y + d}; }, Cost::Unknown, Purity::Pure);
+  };
+
+  // Folded values that aren't literals are cached as the calls they came from and recomputed when loaded
+  const Env env = check_result(Env(registry()).parse_scripts(make_sv_array(script)));
+  const std::vector<std::byte> bytes = check_result(env.serialize_scripts(make_sv_array(script)));
+
+  for(const auto& [expr, expected] : {std::pair("origin()", Point{1, 2}), std::pair("shifted()", Point{4, 5})}) {
+    Env loaded(registry());
+    check_result(loaded.deserialize_scripts(bytes, make_sv_array(script)));
+    check_result(loaded.serialize_scripts(make_sv_array(script)));
+    check_any(expected, execute1(std::move(loaded), expr));
+  }
+
+  for(size_t i = 0; i < bytes.size(); i++) {
+    std::vector<std::byte> corrupt = bytes;
+    corrupt[i] ^= std::byte{0xff};
+    Env corrupted(registry());
+    (void)corrupted.deserialize_scripts(corrupt, make_sv_array(script));
+  }
+}
+
 BOOST_AUTO_TEST_CASE(already_move) {
   constexpr std::string_view script = "fn f(x: unique_int) -> (unique_int, unique_int) { (x, x) }";
 
@@ -712,6 +1048,28 @@ BOOST_AUTO_TEST_CASE(reuse_assign_binding_indirect) {
   check_binding(e, await(std::move(result)), "(i32, i32, i32)", std::tuple(1, 1, 1));
 }
 
+BOOST_AUTO_TEST_CASE(run_after_error) {
+  auto executor = make_seq_executor();
+
+  Env e = check_result(Env(create_primitive_registry()).parse_scripts(make_sv_array("fn f() -> i32 { 3 }")));
+
+  Binding result;
+  std::vector<std::string> errors;
+
+  std::tie(result, e) = check_result(std::move(e).run(executor, "let x = f();"));
+
+  std::tie(errors, e) = check_error_state(std::move(e).run(executor, "g(x)"));
+  BOOST_CHECK(!errors.empty());
+
+  for(int i = 0; i < 3; i++) {
+    std::tie(result, e) = check_result(std::move(e).run(executor, "(clone(&x), f())"));
+    check_binding(e, await(std::move(result)), "(i32, i32)", std::tuple(3, 3));
+  }
+
+  const auto globals = e.globals();
+  BOOST_CHECK_EQUAL(1, std::count_if(globals.begin(), globals.end(), [](const auto& g) { return g.first == "f"; }));
+}
+
 BOOST_AUTO_TEST_CASE(tuple_untuple) {
   auto executor = make_seq_executor();
 
@@ -64,6 +64,17 @@ BOOST_AUTO_TEST_CASE(store_script_function) {
   e = step_and_compare({"37"}, "x()", std::move(e));
 }
 
+BOOST_AUTO_TEST_CASE(reactive) {
+  Env e = Env(create_primitive_registry().add_fn("add", [](i32 x, i32 y) { return x + y; }));
+
+  e = step_and_compare({"Reactive mode on"}, ":r", std::move(e));
+  e = step_and_compare({}, "let x = 1;", std::move(e));
+  e = step_and_compare({}, "let y = add(x, 1);", std::move(e));
+  e = step_and_compare({}, "let x = 5;", std::move(e));
+  e = step_and_compare({"6"}, "y", std::move(e));
+  e = step_and_compare({"Reactive mode off"}, ":r", std::move(e));
+}
+
 BOOST_AUTO_TEST_CASE(no_bindings) { step_and_compare({"0 binding(s)"}, ":b", Env{}); }
 
 BOOST_AUTO_TEST_CASE(single_binding) {
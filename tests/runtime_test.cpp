@@ -2,6 +2,8 @@
 
 #include "constructing_graph.h"
 #include "function_graph.h"
+#include "function_graph_construction.h"
+#include "profiler.h"
 #include "program.h"
 #include "runtime.h"
 #include "runtime_test.h"
@@ -106,6 +108,12 @@ auto execute(Program p, FunctionGraph g, std::tuple<Ts...> ts, std::tuple<Bs...>
   return execute(std::make_shared<Program>(std::move(p)), fn, std::move(ts), std::move(bs));
 }
 
+template <typename... Ts, typename... Bs>
+auto execute_tbb(Program p, FunctionGraph g, std::tuple<Ts...> ts, std::tuple<Bs...> bs) {
+  const Inst fn = p.add(std::move(g));
+  return execute_tbb(std::make_shared<Program>(std::move(p)), fn, std::move(ts), std::move(bs));
+}
+
 } // namespace
 
 BOOST_AUTO_TEST_SUITE(runtime)
@@ -187,6 +195,159 @@ BOOST_AUTO_TEST_CASE(sentinal) {
   BOOST_CHECK_EQUAL(0, any_cast<Sentinal>(results[4]).copies); // inputs[2] is moved after borrowed elsewhere
 }
 
+BOOST_AUTO_TEST_CASE(long_chain) {
+  constexpr int length = 200'000;
+
+  // Cheap and unhinted natives both run inline on the parallel executor, which mustn't recurse once per node
+  for(const Cost cost : {Cost::Unknown, Cost::Cheap}) {
+    const auto chain = [&]() {
+      Program p;
+      const Inst add1 = p.add(create_any_fn([](int x) { return x + 1; }), 1, cost);
+      const Inst take_ref = p.add_fn([](const int& x) { return x; });
+
+      // Borrow the last value so the chain doesn't end in a tail call
+      auto [cg, terms] = make_graph({false});
+      for(int i = 0; i < length; i++) {
+        terms = cg.add(add1, terms, std::array{PassBy::Move}, 1);
+      }
+      const Oterm borrowed = cg.add(take_ref, terms, std::array{PassBy::Borrow}, 1)[0];
+      auto g = std::move(cg).finalize(std::array{borrowed, terms[0]}, std::array{PassBy::Move, PassBy::Move});
+      return std::tuple(std::move(p), std::move(g));
+    };
+
+    auto [p, g] = chain();
+    compare(std::tuple(length, length), execute(std::move(p), std::move(g), std::tuple(0), {}));
+
+    auto [p2, g2] = chain();
+    compare(std::tuple(length, length), execute_tbb(std::move(p2), std::move(g2), std::tuple(0), {}));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(inline_call) {
+  Program p;
+  const Inst add = p.add_fn([](int x, int y) { return x + y; });
+  const Inst functional = p.add(FunctionalInst{}, 1);
+
+  auto [callee_cg, callee_inputs] = make_graph({false, false});
+  const auto sum = callee_cg.add(add, callee_inputs, std::array{PassBy::Copy, PassBy::Copy}, 1);
+  const Inst callee = p.add(std::move(callee_cg).finalize(sum, std::array{PassBy::Copy}));
+
+  const Inst curried = p.placeholder();
+  p.set(curried, callee, std::array{Any(10)});
+
+  // Calls the callee through a fn input then adds the result to itself
+  auto [cg, inputs] = make_graph({false, false, false});
+  const auto call = cg.add(functional, inputs, std::array{PassBy::Copy, PassBy::Copy, PassBy::Copy}, 1);
+  FunctionGraph g = std::move(cg).finalize(
+    cg.add(add, std::array{call[0], call[0]}, std::array{PassBy::Copy, PassBy::Copy}, 1), std::array{PassBy::Copy});
+
+  auto [inlined, p2] = inline_calls(p, g, std::vector<std::optional<Inst>>{callee, std::nullopt, std::nullopt});
+  BOOST_CHECK(stdr::find(inlined.insts, functional) == inlined.insts.end());
+  compare(10, execute(std::move(p2), std::move(inlined), std::tuple(callee, 2, 3), {}));
+
+  // Curried values come after the call's own args
+  auto [cg2, inputs2] = make_graph({false, false});
+  const auto call2 = cg2.add(functional, inputs2, std::array{PassBy::Copy, PassBy::Copy}, 1);
+  FunctionGraph g2 = std::move(cg2).finalize(
+    cg2.add(add, std::array{call2[0], call2[0]}, std::array{PassBy::Copy, PassBy::Copy}, 1), std::array{PassBy::Copy});
+
+  std::tie(inlined, p2) = inline_calls(p, g2, std::vector<std::optional<Inst>>{curried, std::nullopt});
+  BOOST_CHECK(stdr::find(inlined.insts, functional) == inlined.insts.end());
+  compare(24, execute(std::move(p2), std::move(inlined), std::tuple(curried, 2), {}));
+}
+
+BOOST_AUTO_TEST_CASE(fold_pure_nodes) {
+  auto calls = std::make_shared<std::atomic<int>>(0);
+  const auto add = [calls](int x, int y) {
+    ++*calls;
+    return x + y;
+  };
+
+  Program p;
+  const Inst pure_add = p.add(create_any_fn(add), 1, Cost::Unknown, Purity::Pure);
+  const Inst impure_add = p.add(create_any_fn(add), 1);
+  const auto pbs = std::array{PassBy::Copy, PassBy::Copy};
+
+  // Identical pure calls are merged, unknown ones aren't
+  for(const auto [inst, expected_calls] : std::array{std::pair(pure_add, 1), std::pair(impure_add, 2)}) {
+    auto [cg, inputs] = make_graph({false, false});
+    const auto x = cg.add(inst, inputs, pbs, 1);
+    const auto y = cg.add(inst, inputs, pbs, 1);
+    FunctionGraph g = std::move(cg).finalize(std::array{x[0], y[0]}, pbs);
+
+    auto [folded, p2] = ooze::fold_pure_nodes(p, g);
+    BOOST_CHECK_EQUAL(expected_calls, folded.insts.size());
+
+    *calls = 0;
+    compare(std::tuple(5, 5), execute(std::move(p2), std::move(folded), std::tuple(2, 3), {}));
+    BOOST_CHECK_EQUAL(expected_calls, calls->load());
+  }
+
+  // Pure calls on constants are evaluated ahead of time, including ones depending on other folded calls
+  auto [cg, inputs] = make_graph({false});
+  const auto two = cg.add(p.add(Any(2)), {}, {}, 1);
+  const auto three = cg.add(p.add(Any(3)), {}, {}, 1);
+  const auto sum = cg.add(pure_add, std::array{two[0], three[0]}, pbs, 1);
+  const auto sum2 = cg.add(pure_add, std::array{sum[0], sum[0]}, pbs, 1);
+  FunctionGraph g =
+    std::move(cg).finalize(cg.add(pure_add, std::array{sum2[0], inputs[0]}, pbs, 1), std::array{PassBy::Copy});
+
+  auto [folded, p2] = ooze::fold_pure_nodes(p, g);
+  BOOST_CHECK_EQUAL(2, folded.insts.size());
+
+  *calls = 0;
+  compare(11, execute(std::move(p2), std::move(folded), std::tuple(1), {}));
+  BOOST_CHECK_EQUAL(1, calls->load());
+}
+
+BOOST_AUTO_TEST_CASE(lazy) {
+  auto calls = std::make_shared<std::array<std::atomic<int>, 3>>();
+  const auto counter = [calls](int i) {
+    return [calls, i](int x) {
+      ++(*calls)[i];
+      return x;
+    };
+  };
+
+  Program p;
+  const Inst first = p.add(create_any_fn(counter(0)), 1);
+  const Inst second = p.add(create_any_fn(counter(1)), 1);
+  const Inst impure = p.add(create_any_fn(counter(2)), 1, Cost::Unknown, Purity::Impure);
+
+  auto [cg, inputs] = make_graph({false});
+  const auto x = cg.add(first, inputs, std::array{PassBy::Copy}, 1);
+  const auto y = cg.add(second, inputs, std::array{PassBy::Copy}, 1);
+  cg.add(impure, inputs, std::array{PassBy::Copy}, 1);
+  const Inst g =
+    p.add(std::move(cg).finalize(std::array{x[0], y[0]}, std::array{PassBy::Copy, PassBy::Copy}));
+
+  Executor ex = make_seq_executor();
+  std::vector<Future> results(2);
+  execute_lazy(share(std::move(p)), g, ex, to_futures(std::tuple(5)), {}, results, {true, false});
+
+  BOOST_CHECK(!results[1].valid());
+  BOOST_CHECK_EQUAL(5, any_cast<int>(await(std::move(results[0]))));
+  BOOST_CHECK_EQUAL(1, (*calls)[0].load());
+  BOOST_CHECK_EQUAL(0, (*calls)[1].load());
+  BOOST_CHECK_EQUAL(1, (*calls)[2].load());
+}
+
+BOOST_AUTO_TEST_CASE(borrow_curried) {
+  Program p;
+  const Inst copies = p.add_fn([](int x, const Sentinal& s) { return x + s.copies; });
+
+  auto [cg, inputs] = make_graph({false, false});
+  const auto x = cg.add(copies, inputs, std::array{PassBy::Copy, PassBy::Borrow}, 1);
+  FunctionGraph g = borrow_unmoved_inputs(std::move(cg).finalize(x, std::array{PassBy::Move}), {false, true});
+
+  BOOST_CHECK(g.input_borrows == std::vector<bool>({false, true}));
+
+  const Inst curried = p.curry(p.add(std::move(g)), make_vector(Any(Sentinal{})));
+
+  // Only copied once when added to the program
+  compare(6, execute(share(std::move(p)), curried, std::tuple(5), {}));
+}
+
 BOOST_AUTO_TEST_CASE(move_only) {
   Program p;
   const Inst take = p.add_fn([](std::unique_ptr<int> ptr) { return *ptr; });
@@ -456,6 +617,173 @@ BOOST_AUTO_TEST_CASE(if_) {
   compare(2, execute_tbb(share(p), if_diff_cat, std::tuple(false, 1), std::tuple(2)));
 }
 
+BOOST_AUTO_TEST_CASE(tail_recursion) {
+  Program p;
+  const Inst identity = p.add_fn([](int x) { return x; });
+  const Inst is_zero = p.add_fn([](int x) { return x == 0; });
+  const Inst dec = p.add_fn([](int x) { return x - 1; });
+  const Inst loop = p.placeholder();
+  const Inst if_inst = p.add(IfInst{identity, loop, 0, 1}, 1);
+
+  auto [cg, n] = make_graph({false});
+  const auto cond = cg.add(is_zero, n, std::array{PassBy::Copy}, 1);
+  const auto next = cg.add(dec, n, std::array{PassBy::Copy}, 1);
+  const auto result = cg.add(if_inst,
+                             std::array{cond[0], n[0], next[0]},
+                             std::array{PassBy::Move, PassBy::Move, PassBy::Move},
+                             1);
+  p.set(loop, std::move(cg).finalize(result, std::array{PassBy::Move}));
+
+  BOOST_CHECK_EQUAL(1, p.max_arity);
+
+  compare(0, execute(share(p), loop, std::tuple(100'000), {}));
+  compare(0, execute_tbb(share(p), loop, std::tuple(100'000), {}));
+}
+
+BOOST_AUTO_TEST_CASE(side_effects) {
+  Program p;
+  const Inst identity = p.add_fn([](int x) { return x; });
+  const Inst log = p.add(create_any_fn([](int x) { return x; }), 1, Cost::Unknown, Purity::Impure);
+  const Inst is_zero = p.add_fn([](int x) { return x == 0; });
+  const Inst dec = p.add_fn([](int x) { return x - 1; });
+
+  // Branches of an if can be fns, and a loop's else branch recurses back into it
+  const auto add_loop = [&](Inst exit) {
+    const Inst loop = p.placeholder();
+    auto [cg, n] = make_graph({false});
+    const auto cond = cg.add(is_zero, n, std::array{PassBy::Copy}, 1);
+    const auto next = cg.add(dec, n, std::array{PassBy::Copy}, 1);
+    const auto result = cg.add(p.add(IfInst{exit, loop, 0, 1}, 1),
+                               std::array{cond[0], n[0], next[0]},
+                               std::array{PassBy::Move, PassBy::Move, PassBy::Move},
+                               1);
+    p.set(loop, std::move(cg).finalize(result, std::array{PassBy::Move}));
+    return loop;
+  };
+
+  const Inst pure_loop = add_loop(identity);
+  const Inst impure_loop = add_loop(log);
+
+  BOOST_CHECK(!has_side_effects(p, pure_loop));
+  BOOST_CHECK(has_side_effects(p, impure_loop));
+  BOOST_CHECK(has_side_effects(p, p.add(IfInst{identity, log, 0, 1}, 1)));
+}
+
+BOOST_AUTO_TEST_CASE(stream) {
+  Program p;
+  const Inst square = p.add_fn([](int x) { return x * x; });
+  const Inst inc = p.add_fn([](int x) { return x + 1; });
+
+  auto [cg, inputs] = make_graph({false});
+  const auto squared = cg.add(square, inputs, std::array{PassBy::Move}, 1);
+  const auto result = cg.add(inc, squared, std::array{PassBy::Move}, 1);
+  const Inst graph = p.add(std::move(cg).finalize(result, std::array{PassBy::Move}));
+
+  const auto shared = share(p);
+  constexpr int window = 4;
+
+  const auto check = [&](Executor& ex) {
+    int pulled = 0;
+    std::vector<int> results;
+    execute_stream(
+      shared,
+      graph,
+      ex,
+      window,
+      [&]() -> std::optional<std::vector<Any>> {
+        if(pulled == 100) {
+          return std::nullopt;
+        }
+        std::vector<Any> inputs;
+        inputs.emplace_back(pulled++);
+        return inputs;
+      },
+      [&](std::vector<Any> outputs) {
+        BOOST_CHECK_LE(pulled - int(results.size()), window);
+        BOOST_REQUIRE_EQUAL(1, outputs.size());
+        results.push_back(any_cast<int>(outputs[0]));
+      });
+
+    BOOST_REQUIRE_EQUAL(100, results.size());
+    for(int i = 0; i < 100; i++) {
+      BOOST_CHECK_EQUAL(i * i + 1, results[i]);
+    }
+  };
+
+  Executor seq = make_seq_executor();
+  check(seq);
+
+  Executor tbb = make_tbb_executor();
+  check(tbb);
+
+  // Invocations without outputs only leave the window once they've finished
+  auto finished = std::make_shared<std::atomic<int>>(0);
+  Program q;
+  const Inst count = q.add_fn([finished](int) { ++*finished; });
+  const auto shared_count = share(std::move(q));
+
+  const auto check_no_outputs = [&](Executor& ex) {
+    *finished = 0;
+    int pulled = 0;
+    int sunk = 0;
+    execute_stream(
+      shared_count,
+      count,
+      ex,
+      window,
+      [&]() -> std::optional<std::vector<Any>> {
+        if(pulled == 100) {
+          return std::nullopt;
+        }
+        std::vector<Any> inputs;
+        inputs.emplace_back(pulled++);
+        return inputs;
+      },
+      [&](std::vector<Any> outputs) {
+        BOOST_CHECK(outputs.empty());
+        BOOST_CHECK_LE(pulled - sunk, window);
+        BOOST_CHECK_LE(++sunk, finished->load());
+      });
+
+    BOOST_CHECK_EQUAL(100, sunk);
+    BOOST_CHECK_EQUAL(100, finished->load());
+  };
+
+  check_no_outputs(seq);
+  check_no_outputs(tbb);
+}
+
+BOOST_AUTO_TEST_CASE(profile) {
+  Program p;
+  const Inst add = p.add_fn([](int x, int y) { return x + y; });
+  p.names.emplace(add, "add");
+
+  // Output the sum twice so add isn't a tail call
+  auto [cg, inputs] = make_graph({false, false});
+  const auto sum = cg.add(add, inputs, std::array{PassBy::Copy, PassBy::Copy}, 1);
+  const Inst graph =
+    p.add(std::move(cg).finalize(std::array{sum[0], sum[0]}, std::array{PassBy::Copy, PassBy::Copy}));
+  p.names.emplace(graph, "sum");
+
+  Profiler profiler;
+  set_active_profiler(&profiler);
+  compare(std::tuple(3, 3), execute_tbb(share(p), graph, std::tuple(1, 2), {}));
+  set_active_profiler(nullptr);
+
+  const std::vector<ProfileEvent> events = profiler.events();
+  BOOST_REQUIRE_EQUAL(2, events.size());
+  BOOST_CHECK(graph == events[0].inst);
+  BOOST_CHECK(add == events[1].inst);
+  BOOST_CHECK_EQUAL(events[0].id, events[1].parent);
+
+  const std::string stacks = collapsed_stacks(profiler);
+  BOOST_CHECK(stacks.starts_with("sum;add "));
+
+  const std::string trace = chrome_trace(profiler);
+  BOOST_CHECK(trace.find("\"name\":\"sum\"") != std::string::npos);
+  BOOST_CHECK(trace.find("\"name\":\"add\"") != std::string::npos);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
 BOOST_AUTO_TEST_SUITE(stress)
@@ -181,6 +181,38 @@ BOOST_AUTO_TEST_CASE(fn) {
   test_unify_error("fn(f32) -> i32", "fn(i32) -> i32");
 }
 
+BOOST_AUTO_TEST_CASE(interned) {
+  TestEnv env = basic_test_env();
+  const TypeCache tc = create_type_cache(env.ast.tg);
+  const auto srcs = make_sv_array(env.src, "(i32, _)", "(_, f32)");
+
+  auto [xid, tg2] = type_graph_of(srcs, env.types.names, SrcID{1}, std::move(env.ast.tg));
+  auto [yid, tg] = type_graph_of(srcs, env.types.names, SrcID{2}, std::move(tg2));
+
+  const Type unified = unify(tc, tg, xid, yid, true);
+  const i32 num_nodes = tg.num_nodes();
+
+  BOOST_CHECK(unify(tc, tg, xid, yid, true) == unified);
+  BOOST_CHECK(unify(tc, tg, unified, yid, true) == unified);
+  BOOST_CHECK(unify(tc, tg, unified, unified, true) == unified);
+  BOOST_CHECK_EQUAL(num_nodes, tg.num_nodes());
+}
+
+BOOST_AUTO_TEST_CASE(interned_names) {
+  TestEnv env = basic_test_env();
+  const auto srcs = make_sv_array(env.src, "(i32, &i32)", "fn((i32, &i32)) -> &i32");
+
+  const Type native_fn = add_fn_type(env.ast.tg, knot::Type<void (*)(i32, const i32&)>{});
+  const Type native_args = env.ast.tg.fanout(native_fn)[0];
+
+  auto [args, tg2] = type_graph_of(srcs, env.types.names, SrcID{1}, std::move(env.ast.tg));
+  BOOST_CHECK(args == native_args);
+
+  auto [fn, tg] = type_graph_of(srcs, env.types.names, SrcID{2}, std::move(tg2));
+  BOOST_CHECK(tg.fanout(tg.fanout(fn)[0])[0] == native_args);
+  BOOST_CHECK(tg.fanout(fn)[1] == tg.fanout(native_args)[1]);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
 BOOST_AUTO_TEST_SUITE(alr)